@@ -0,0 +1,46 @@
+#include "blocking.h"
+
+#include "executor.h"
+#include "task.h"
+
+namespace theta {
+
+ScopedBlocking::ScopedBlocking() {
+  Task* task = Task::current();
+  if (!task || !task->holds_active_) {
+    return;
+  }
+
+  task_ = task;
+  ExecutorImpl::get_tv(&begin_tv_);
+
+  ExecutorImpl* executor = task_->opts().executor();
+  task_->holds_active_ = false;
+  executor->stats()->blocked_delta(1);
+  executor->unreserve_active();
+  executor->refill_queues();
+}
+
+ScopedBlocking::~ScopedBlocking() {
+  if (!task_) {
+    return;
+  }
+
+  timeval end_tv;
+  ExecutorImpl::get_tv(&end_tv);
+  task_->blocked_sec_ += (end_tv.tv_sec - begin_tv_.tv_sec) +
+                         (end_tv.tv_usec - begin_tv_.tv_usec) / 1e6;
+
+  ExecutorImpl* executor = task_->opts().executor();
+  executor->stats()->blocked_delta(-1);
+  if (executor->reserve_active()) {
+    task_->holds_active_ = true;
+  } else {
+    // The slot went to the task that was admitted in our place, so yield the
+    // CPU to it for the rest of this task. Finishing the task unthrottles it.
+    task_->throttle_pinned_ = true;
+    executor->throttle_list_.throttle(task_);
+  }
+}
+
+}  // namespace theta
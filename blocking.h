@@ -0,0 +1,42 @@
+#pragma once
+
+#include <sys/time.h>
+
+#include <utility>
+
+namespace theta {
+
+class ExecutorImpl;
+class Task;
+
+// Marks a region of a task where it is expected to block, e.g. on a lock, on
+// disk or on an RPC.
+//
+// Entering the region immediately gives the task's active slot back to its
+// executor and admits another task in its place, instead of waiting for the
+// scaler to notice that the executor's usage proportion dropped. Leaving the
+// region takes a slot back if one is free. Otherwise, the task finishes as a
+// throttled task that no longer counts against the active limit.
+//
+// Outside of a task, and inside of a nested region, this does nothing.
+class ScopedBlocking {
+ public:
+  ScopedBlocking();
+  ~ScopedBlocking();
+
+  ScopedBlocking(const ScopedBlocking&) = delete;
+  void operator=(const ScopedBlocking&) = delete;
+
+ private:
+  Task* task_{nullptr};
+  timeval begin_tv_;
+};
+
+// Runs func inside of a ScopedBlocking region and returns its result.
+template <typename Func>
+decltype(auto) blocking(Func&& func) {
+  ScopedBlocking scoped_blocking;
+  return std::forward<Func>(func)();
+}
+
+}  // namespace theta
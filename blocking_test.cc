@@ -0,0 +1,94 @@
+#include "blocking.h"
+
+#include <glog/logging.h>
+
+#include <chrono>
+#include <latch>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+TEST(ScopedBlocking, outside_of_task) {
+  ScopedBlocking scoped_blocking;
+  EXPECT_EQ(blocking([]() { return 5; }), 5);
+}
+
+TEST(ScopedBlocking, admits_another_task) {
+  // With a single active slot, the first task can only finish if the second
+  // one is admitted while the first one is blocked.
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::FIFO)
+          .set_worker_limit(1));
+
+  std::latch second_ran{1};
+  std::latch both_done{2};
+
+  executor.post([&]() {
+    blocking([&]() { second_ran.wait(); });
+    both_done.count_down();
+  });
+  executor.post([&]() {
+    second_ran.count_down();
+    both_done.count_down();
+  });
+
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (!both_done.try_wait() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_TRUE(both_done.try_wait());
+}
+
+TEST(ScopedBlocking, throttles_when_no_slot_is_free) {
+  // The second task takes the only active slot while the first one is
+  // blocked, and keeps it until the first one has left the region.
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::FIFO)
+          .set_worker_limit(1));
+
+  std::latch second_started{1};
+  std::latch first_checked{1};
+  std::latch both_done{2};
+  ExecutorImpl* impl = nullptr;
+  Task::State state_after = Task::State::kCreated;
+  int throttled_after = -1;
+
+  executor.post([&]() {
+    blocking([&]() { second_started.wait(); });
+    Task* task = Task::current();
+    impl = task->opts().executor();
+    state_after = task->state();
+    throttled_after = impl->stats()->throttled_num();
+    first_checked.count_down();
+    both_done.count_down();
+  });
+  executor.post([&]() {
+    second_started.count_down();
+    first_checked.wait();
+    both_done.count_down();
+  });
+
+  auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (!both_done.try_wait() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(10ms);
+  }
+  ASSERT_TRUE(both_done.try_wait());
+  EXPECT_EQ(state_after, Task::State::kThrottled);
+  EXPECT_EQ(throttled_after, 1);
+
+  // Finishing the first task takes it out of the throttled count.
+  while (impl->stats()->throttled_num() != 0 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(impl->stats()->throttled_num(), 0);
+}
+
+}  // namespace theta
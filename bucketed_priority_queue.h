@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "queue.h"
+
+namespace theta {
+
+// A concurrent priority queue with a small, fixed number of priority levels.
+// Every level is a FIFO Queue, and a bitmap tracks which levels may be
+// non-empty, so finding the highest priority is a single count of trailing
+// zeros instead of a heap operation.
+//
+// Higher priorities pop first. Priorities outside of [0, kLevels) are
+// clamped. Within a level, values pop in roughly the order that they were
+// pushed.
+//
+// Each level's lock-free Queue is bounded. When it is full, pushes to that
+// level go to an overflow deque behind a mutex until the overflow drains,
+// which keeps a level's values in order.
+template <AtomType T, size_t kLevels = 64, size_t kLevelBufferSize = 32>
+class BucketedPriorityQueue {
+  static_assert(kLevels > 0 && kLevels <= 64, "The bitmap is a uint64_t");
+
+ public:
+  static constexpr int kMinPriority = 0;
+  static constexpr int kMaxPriority = kLevels - 1;
+
+  static int clamp_priority(int priority) {
+    return std::clamp(priority, kMinPriority, kMaxPriority);
+  }
+
+  void push(T val, int priority) {
+    int level = clamp_priority(priority);
+    auto& l = levels_[level];
+
+    if (l.overflow_size.load(std::memory_order::acquire) > 0 ||
+        !l.queue.try_push(val)) {
+      std::lock_guard lock{l.overflow_mu};
+      l.overflow.push_back(val);
+      l.overflow_size.fetch_add(1, std::memory_order::release);
+    }
+
+    // Set the bit after the value is visible. See try_pop for why a pop
+    // that clears the bit concurrently cannot lose it.
+    bitmap_.fetch_or(bit(level), std::memory_order::seq_cst);
+  }
+
+  std::optional<T> try_pop() {
+    while (true) {
+      uint64_t bitmap = bitmap_.load(std::memory_order::seq_cst);
+      if (!bitmap) {
+        return {};
+      }
+
+      int level = kMaxPriority - std::countr_zero(bitmap);
+      if (auto val = try_pop_level(level); val.has_value()) {
+        return val;
+      }
+
+      // The level looked empty, so clear its bit. A push that raced with
+      // this either set the bit after the clear, or published its value
+      // before it, in which case the check below finds it.
+      bitmap_.fetch_and(~bit(level), std::memory_order::seq_cst);
+      if (auto val = try_pop_level(level); val.has_value()) {
+        bitmap_.fetch_or(bit(level), std::memory_order::seq_cst);
+        return val;
+      }
+    }
+  }
+
+ private:
+  struct alignas(hardware_destructive_interference_size) Level {
+    Queue<T, kLevelBufferSize> queue;
+
+    std::atomic<size_t> overflow_size{0};
+    std::mutex overflow_mu;
+    std::deque<T> overflow;
+  };
+
+  // Bit 0 is the highest priority, so that countr_zero finds it.
+  static constexpr uint64_t bit(int level) {
+    return uint64_t{1} << (kMaxPriority - level);
+  }
+
+  std::optional<T> try_pop_level(int level) {
+    auto& l = levels_[level];
+    if (auto val = l.queue.try_pop(); val.has_value()) {
+      return val;
+    }
+
+    if (l.overflow_size.load(std::memory_order::acquire) == 0) {
+      return {};
+    }
+    std::lock_guard lock{l.overflow_mu};
+    if (l.overflow.empty()) {
+      return {};
+    }
+    T val = l.overflow.front();
+    l.overflow.pop_front();
+    l.overflow_size.fetch_sub(1, std::memory_order::release);
+    return val;
+  }
+
+  std::atomic<uint64_t> bitmap_{0};
+  std::array<Level, kLevels> levels_;
+};
+
+}  // namespace theta
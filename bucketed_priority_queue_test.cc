@@ -0,0 +1,101 @@
+#include "bucketed_priority_queue.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+TEST(BucketedPriorityQueue, empty) {
+  BucketedPriorityQueue<int*> queue;
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(BucketedPriorityQueue, pops_highest_priority_first) {
+  BucketedPriorityQueue<int*> queue;
+  int vals[5];
+  for (int i : {3, 0, 4, 1, 2}) {
+    queue.push(&vals[i], i * 10);
+  }
+
+  for (int i = 4; i >= 0; i--) {
+    auto val = queue.try_pop();
+    ASSERT_TRUE(val.has_value());
+    EXPECT_EQ(val.value(), &vals[i]);
+  }
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(BucketedPriorityQueue, fifo_within_a_level_past_the_buffer) {
+  // More values than a level's lock-free buffer holds, so some go to the
+  // overflow.
+  static constexpr int kNum = 1000;
+  BucketedPriorityQueue<int*, 64, 8> queue;
+  std::vector<int> vals(kNum);
+  for (int i = 0; i < kNum; i++) {
+    queue.push(&vals[i], 7);
+  }
+
+  for (int i = 0; i < kNum; i++) {
+    auto val = queue.try_pop();
+    ASSERT_TRUE(val.has_value());
+    EXPECT_EQ(val.value(), &vals[i]);
+  }
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(BucketedPriorityQueue, clamps_priorities) {
+  using Q = BucketedPriorityQueue<int*, 8>;
+  EXPECT_EQ(Q::clamp_priority(-5), Q::kMinPriority);
+  EXPECT_EQ(Q::clamp_priority(1000), Q::kMaxPriority);
+  EXPECT_EQ(Q::clamp_priority(3), 3);
+
+  Q queue;
+  int low, mid, high, higher;
+  queue.push(&low, -5);
+  queue.push(&mid, 3);
+  queue.push(&high, 1000);
+  queue.push(&higher, Q::kMaxPriority);
+
+  // Clamped values share the edge levels in push order.
+  EXPECT_EQ(queue.try_pop().value(), &high);
+  EXPECT_EQ(queue.try_pop().value(), &higher);
+  EXPECT_EQ(queue.try_pop().value(), &mid);
+  EXPECT_EQ(queue.try_pop().value(), &low);
+}
+
+TEST(BucketedPriorityQueue, concurrent_push_pop) {
+  static constexpr int kThreads = 4;
+  static constexpr int kPerThread = 20000;
+  BucketedPriorityQueue<int*> queue;
+  int val;
+
+  std::atomic<int> popped{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kPerThread; i++) {
+        queue.push(&val, (i * 7 + t) % 80 - 8);
+      }
+    });
+    threads.emplace_back([&]() {
+      while (popped.load() < kThreads * kPerThread) {
+        if (queue.try_pop().has_value()) {
+          popped.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(popped.load(), kThreads * kPerThread);
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+}  // namespace theta
@@ -0,0 +1,74 @@
+#include "controller.h"
+
+#include <algorithm>
+
+namespace theta {
+
+namespace {
+
+// Keeps a task that never touches the CPU from asking for infinite workers.
+constexpr double kMinUsageProportion = 0.01;
+
+}  // namespace
+
+size_t UsageController::active_limit(const ControllerInputs& inputs) {
+  return inputs.cpu_share /
+         std::max(kMinUsageProportion, inputs.usage_proportion);
+}
+
+/*static*/
+ControllerFactory UsageController::factory() {
+  return []() { return std::make_unique<UsageController>(); };
+}
+
+size_t HillClimbingController::active_limit(const ControllerInputs& inputs) {
+  double ceiling =
+      std::max<double>(1.0, UsageController{}.active_limit(inputs));
+  if (limit_ == 0.0) {
+    limit_ = inputs.active_limit ? inputs.active_limit : ceiling;
+  }
+
+  double throughput = inputs.completions_per_sec;
+  if (inputs.queue_depth == 0) {
+    // The limit is not what is holding the executor back, so there is nothing
+    // to learn from this interval.
+    last_throughput_ = throughput;
+    last_queue_wait_sec_ = inputs.queue_wait_sec;
+    limit_ = std::clamp(limit_, 1.0, ceiling);
+    return limit_;
+  }
+
+  if (throughput > last_throughput_ * (1.0 + kTolerance)) {
+    step_ = std::min(step_ + 1, kMaxStep);
+  } else if (throughput < last_throughput_ * (1.0 - kTolerance)) {
+    // Adding tasks made things worse and they are piling up in the queue, so
+    // the executor is past the knee and contending with itself.
+    if (direction_ > 0 && inputs.queue_wait_sec > last_queue_wait_sec_) {
+      limit_ *= kBackoff;
+    }
+    direction_ = -direction_;
+    step_ = 1;
+  } else {
+    step_ = 1;
+  }
+
+  limit_ += direction_ * static_cast<double>(step_);
+  if (limit_ >= ceiling) {
+    limit_ = ceiling;
+    direction_ = -1;
+  } else if (limit_ <= 1.0) {
+    limit_ = 1.0;
+    direction_ = 1;
+  }
+
+  last_throughput_ = throughput;
+  last_queue_wait_sec_ = inputs.queue_wait_sec;
+  return limit_;
+}
+
+/*static*/
+ControllerFactory HillClimbingController::factory() {
+  return []() { return std::make_unique<HillClimbingController>(); };
+}
+
+}  // namespace theta
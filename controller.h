@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace theta {
+
+// What the scaler knows about an executor when it recomputes the executor's
+// active limit. Rates and times are EMAs over the executor's tau.
+struct ControllerInputs {
+  // Wall time since the previous scaler pass.
+  double interval_sec{0.0};
+  // The CPUs that the fair share split granted to the executor.
+  double cpu_share{1.0};
+  // The proportion of a task's wall time that is spent on a CPU.
+  double usage_proportion{1.0};
+  double completions_per_sec{0.0};
+  // Time from post until a worker starts the task.
+  double queue_wait_sec{0.0};
+  // Tasks that are posted but not yet running.
+  size_t queue_depth{0};
+  size_t active_limit{0};
+  size_t worker_limit{0};
+};
+
+// Decides how many tasks an executor may have active at once. Controllers are
+// only called from the scaler thread, one executor at a time, so they do not
+// need to be thread safe.
+class ConcurrencyController {
+ public:
+  virtual ~ConcurrencyController() {}
+
+  // The caller clamps the result to [1, worker_limit].
+  virtual size_t active_limit(const ControllerInputs& inputs) = 0;
+};
+
+using ControllerFactory =
+    std::function<std::unique_ptr<ConcurrencyController>()>;
+
+// Allows as many active tasks as it takes to fill cpu_share given the measured
+// usage proportion, e.g. twice as many tasks as CPUs if tasks spend half of
+// their time blocked. This is the default.
+class UsageController : public ConcurrencyController {
+ public:
+  size_t active_limit(const ControllerInputs& inputs) override;
+
+  static ControllerFactory factory();
+};
+
+// Searches for the active limit that maximizes completions per second. While
+// there is a backlog, each pass moves the limit one step in the current
+// direction. Steps grow additively while throughput keeps improving, and the
+// limit is cut multiplicatively when throughput falls while queue wait rises.
+// The UsageController's limit is the ceiling, so the search never takes more
+// than the executor's fair share of the CPUs.
+class HillClimbingController : public ConcurrencyController {
+ public:
+  // Throughput changes smaller than this are treated as noise.
+  static constexpr double kTolerance = 0.05;
+  static constexpr double kBackoff = 0.75;
+  static constexpr size_t kMaxStep = 8;
+
+  size_t active_limit(const ControllerInputs& inputs) override;
+
+  static ControllerFactory factory();
+
+ private:
+  double limit_{0.0};
+  double last_throughput_{0.0};
+  double last_queue_wait_sec_{0.0};
+  int direction_{1};
+  size_t step_{1};
+};
+
+}  // namespace theta
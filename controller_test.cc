@@ -0,0 +1,69 @@
+#include "controller.h"
+
+#include <glog/logging.h>
+
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+TEST(UsageController, active_limit) {
+  UsageController controller;
+  EXPECT_EQ(controller.active_limit(ControllerInputs{
+                .cpu_share = 8.0, .usage_proportion = 1.0}),
+            8);
+  EXPECT_EQ(controller.active_limit(ControllerInputs{
+                .cpu_share = 8.0, .usage_proportion = 0.25}),
+            32);
+}
+
+TEST(HillClimbingController, converges_on_peak) {
+  // Throughput peaks at 20 active tasks and falls off on either side.
+  static constexpr double kPeak = 20.0;
+  auto throughput = [](double limit) {
+    return 1000.0 - (limit - kPeak) * (limit - kPeak);
+  };
+
+  HillClimbingController controller;
+  ControllerInputs inputs{.interval_sec = 0.1,
+                          .cpu_share = 16.0,
+                          .usage_proportion = 0.25,
+                          .queue_depth = 100,
+                          .active_limit = 4,
+                          .worker_limit = 1000};
+
+  double sum = 0.0;
+  int samples = 0;
+  for (int i = 0; i < 200; i++) {
+    inputs.completions_per_sec = throughput(inputs.active_limit);
+    inputs.queue_wait_sec = 1.0 / inputs.completions_per_sec;
+    inputs.active_limit = controller.active_limit(inputs);
+    if (i >= 100) {
+      sum += inputs.active_limit;
+      samples++;
+    }
+  }
+
+  EXPECT_NEAR(sum / samples, kPeak, 3.0);
+}
+
+TEST(HillClimbingController, respects_fair_share) {
+  HillClimbingController controller;
+  ControllerInputs inputs{.interval_sec = 0.1,
+                          .cpu_share = 2.0,
+                          .usage_proportion = 1.0,
+                          .queue_depth = 100,
+                          .active_limit = 1,
+                          .worker_limit = 1000};
+
+  for (int i = 0; i < 100; i++) {
+    // Throughput that keeps rising with the limit.
+    inputs.completions_per_sec = 100.0 * inputs.active_limit;
+    inputs.active_limit = controller.active_limit(inputs);
+    EXPECT_LE(inputs.active_limit, 2);
+    EXPECT_GE(inputs.active_limit, 1);
+  }
+}
+
+}  // namespace theta
@@ -0,0 +1,193 @@
+#include "cpu_capacity.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace theta {
+
+namespace {
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+template <typename T>
+std::optional<T> parse_number(std::string_view s) {
+  T val{};
+  auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), val);
+  if (ec != std::errc{} || ptr != s.data() + s.size()) {
+    return {};
+  }
+  return val;
+}
+
+}  // namespace
+
+double CpuCapacity::detect() const {
+  double capacity = std::max(1U, std::thread::hardware_concurrency());
+
+  if (auto affinity = affinity_size(); affinity.has_value()) {
+    capacity = std::min(capacity, static_cast<double>(affinity.value()));
+  }
+  if (auto cpuset = cgroup_cpuset_size(); cpuset.has_value()) {
+    capacity = std::min(capacity, static_cast<double>(cpuset.value()));
+  }
+  if (auto quota = cgroup_quota(); quota.has_value()) {
+    capacity = std::min(capacity, quota.value());
+  }
+
+  return std::max(1.0, capacity);
+}
+
+/*static*/
+std::optional<double> CpuCapacity::parse_cpu_max(std::string_view contents) {
+  contents = trim(contents);
+  auto space = contents.find(' ');
+  if (space == std::string_view::npos) {
+    return {};
+  }
+
+  auto quota_str = contents.substr(0, space);
+  auto period_str = trim(contents.substr(space + 1));
+  if (quota_str == "max") {
+    return {};
+  }
+
+  auto quota = parse_number<uint64_t>(quota_str);
+  auto period = parse_number<uint64_t>(period_str);
+  if (!quota.has_value() || !period.has_value() || period.value() == 0) {
+    return {};
+  }
+
+  return static_cast<double>(quota.value()) / period.value();
+}
+
+/*static*/
+std::vector<int> CpuCapacity::parse_cpu_list(std::string_view contents) {
+  std::vector<int> cpus;
+  contents = trim(contents);
+
+  while (!contents.empty()) {
+    auto comma = contents.find(',');
+    auto range = trim(contents.substr(0, comma));
+    contents = comma == std::string_view::npos ? std::string_view{}
+                                               : contents.substr(comma + 1);
+    if (range.empty()) {
+      continue;
+    }
+
+    auto dash = range.find('-');
+    if (dash == std::string_view::npos) {
+      if (auto cpu = parse_number<int>(range); cpu.has_value()) {
+        cpus.push_back(cpu.value());
+      }
+      continue;
+    }
+
+    auto first = parse_number<int>(range.substr(0, dash));
+    auto last = parse_number<int>(range.substr(dash + 1));
+    if (!first.has_value() || !last.has_value()) {
+      continue;
+    }
+    for (int cpu = first.value(); cpu <= last.value(); cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return cpus;
+}
+
+std::optional<std::string> CpuCapacity::read_file(
+    const std::string& path) const {
+  std::ifstream in{root_ + path};
+  if (!in) {
+    return {};
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+std::optional<std::string> CpuCapacity::cgroup_dir() const {
+  // On a cgroup v2 host, /proc/self/cgroup has a single "0::<path>" line.
+  auto contents = read_file("/proc/self/cgroup");
+  if (!contents.has_value()) {
+    return {};
+  }
+
+  std::istringstream lines{contents.value()};
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.starts_with("0::")) {
+      return "/sys/fs/cgroup" + line.substr(3);
+    }
+  }
+  return {};
+}
+
+std::optional<double> CpuCapacity::cgroup_quota() const {
+  auto dir = cgroup_dir();
+  if (!dir.has_value()) {
+    return {};
+  }
+
+  // Every ancestor's quota also applies, so walk up to the root.
+  std::optional<double> quota;
+  std::string path = dir.value();
+  while (true) {
+    if (auto contents = read_file(path + "/cpu.max"); contents.has_value()) {
+      if (auto q = parse_cpu_max(contents.value()); q.has_value()) {
+        quota = quota.has_value() ? std::min(quota.value(), q.value())
+                                  : q.value();
+      }
+    }
+
+    if (path.size() <= std::string_view{"/sys/fs/cgroup"}.size()) {
+      break;
+    }
+    path = path.substr(0, path.rfind('/'));
+  }
+
+  return quota;
+}
+
+std::optional<size_t> CpuCapacity::cgroup_cpuset_size() const {
+  auto dir = cgroup_dir();
+  if (!dir.has_value()) {
+    return {};
+  }
+
+  auto contents = read_file(dir.value() + "/cpuset.cpus.effective");
+  if (!contents.has_value()) {
+    return {};
+  }
+
+  auto cpus = parse_cpu_list(contents.value());
+  if (cpus.empty()) {
+    return {};
+  }
+  return cpus.size();
+}
+
+std::optional<size_t> CpuCapacity::affinity_size() const {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return {};
+  }
+  return CPU_COUNT(&set);
+}
+
+}  // namespace theta
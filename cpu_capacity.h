@@ -0,0 +1,46 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace theta {
+
+// Detects how many CPUs this process may actually use. The result is the
+// smallest of
+//   * the number of CPUs in the sched_getaffinity mask,
+//   * the number of CPUs in the cgroup v2 cpuset.cpus.effective, and
+//   * the cgroup v2 cpu.max quota divided by its period, taking the most
+//     restrictive value along the path to the cgroup root.
+//
+// std::thread::hardware_concurrency() reports the host core count, which can
+// be an order of magnitude larger than the quota inside of a container.
+class CpuCapacity {
+ public:
+  // The root is prepended to every path that is read, which lets tests point
+  // detection at a fake filesystem.
+  explicit CpuCapacity(std::string root = "") : root_(std::move(root)) {}
+
+  // Never returns less than 1.0.
+  double detect() const;
+
+  // Parses the contents of a cpu.max file, e.g. "800000 100000". Returns
+  // nothing if there is no quota ("max 100000") or the contents are malformed.
+  static std::optional<double> parse_cpu_max(std::string_view contents);
+
+  // Parses a cpu list, e.g. "0-3,8,10-11\n".
+  static std::vector<int> parse_cpu_list(std::string_view contents);
+
+ private:
+  std::string root_;
+
+  std::optional<std::string> read_file(const std::string& path) const;
+  std::optional<std::string> cgroup_dir() const;
+  std::optional<double> cgroup_quota() const;
+  std::optional<size_t> cgroup_cpuset_size() const;
+  std::optional<size_t> affinity_size() const;
+};
+
+}  // namespace theta
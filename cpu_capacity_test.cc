@@ -0,0 +1,79 @@
+#include "cpu_capacity.h"
+
+#include <glog/logging.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+namespace {
+
+class FakeRoot {
+ public:
+  FakeRoot()
+      : root_(std::filesystem::temp_directory_path() /
+              ("cpu_capacity_test." + std::to_string(getpid()))) {
+    std::filesystem::remove_all(root_);
+  }
+
+  ~FakeRoot() { std::filesystem::remove_all(root_); }
+
+  void write(const std::string& path, const std::string& contents) {
+    auto full = root_ / path.substr(1);
+    std::filesystem::create_directories(full.parent_path());
+    std::ofstream{full} << contents;
+  }
+
+  std::string path() const { return root_.string(); }
+
+ private:
+  std::filesystem::path root_;
+};
+
+}  // namespace
+
+TEST(CpuCapacity, parse_cpu_max) {
+  EXPECT_EQ(CpuCapacity::parse_cpu_max("800000 100000\n"), 8.0);
+  EXPECT_EQ(CpuCapacity::parse_cpu_max("150000 100000"), 1.5);
+  EXPECT_FALSE(CpuCapacity::parse_cpu_max("max 100000\n").has_value());
+  EXPECT_FALSE(CpuCapacity::parse_cpu_max("100000 0").has_value());
+  EXPECT_FALSE(CpuCapacity::parse_cpu_max("garbage").has_value());
+}
+
+TEST(CpuCapacity, parse_cpu_list) {
+  EXPECT_EQ(CpuCapacity::parse_cpu_list("0-3,8,10-11\n"),
+            (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(CpuCapacity::parse_cpu_list("5"), (std::vector<int>{5}));
+  EXPECT_TRUE(CpuCapacity::parse_cpu_list("\n").empty());
+}
+
+TEST(CpuCapacity, quota) {
+  FakeRoot root;
+  root.write("/proc/self/cgroup", "0::/kubepods/pod\n");
+  root.write("/sys/fs/cgroup/kubepods/cpu.max", "400000 100000\n");
+  root.write("/sys/fs/cgroup/kubepods/pod/cpu.max", "max 100000\n");
+
+  double expected = std::min(4.0, CpuCapacity{}.detect());
+  EXPECT_EQ(CpuCapacity{root.path()}.detect(), expected);
+}
+
+TEST(CpuCapacity, cpuset) {
+  FakeRoot root;
+  root.write("/proc/self/cgroup", "0::/pod\n");
+  root.write("/sys/fs/cgroup/pod/cpuset.cpus.effective", "0\n");
+
+  EXPECT_EQ(CpuCapacity{root.path()}.detect(), 1.0);
+}
+
+TEST(CpuCapacity, no_cgroup) {
+  FakeRoot root;
+  EXPECT_LE(CpuCapacity{root.path()}.detect(),
+            std::max(1U, std::thread::hardware_concurrency()));
+  EXPECT_GE(CpuCapacity{root.path()}.detect(), 1.0);
+}
+
+}  // namespace theta
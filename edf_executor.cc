@@ -0,0 +1,118 @@
+#include "edf_executor.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "epoch.h"
+#include "probes.h"
+
+namespace theta {
+
+namespace {
+
+int64_t to_nsec(std::chrono::time_point<ExecutorImpl::Clock> tp) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             tp.time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+EDFExecutorImpl::~EDFExecutorImpl() {
+  for (auto& shard : shards_) {
+    std::lock_guard l{shard.mu};
+    while (!shard.heap.empty()) {
+      delete shard.heap.top().task;
+      shard.heap.pop();
+    }
+  }
+}
+
+void EDFExecutorImpl::post(Executor::Func func) {
+  auto* task = new Task{Task::Opts{}.set_func(func).set_executor(this)};
+  push(task, kNoDeadline);
+}
+
+void EDFExecutorImpl::post(Executor::Func func,
+                           std::chrono::time_point<Clock> deadline,
+                           Executor::Func expireCallback) {
+  auto* task = new Task{Task::Opts{}
+                            .set_func(func)
+                            .set_expire_func(expireCallback)
+                            .set_deadline(deadline)
+                            .set_executor(this)};
+  push(task, std::min(to_nsec(deadline), kNoDeadline));
+}
+
+void EDFExecutorImpl::post_batch(std::vector<Func> funcs) {
+  // The whole batch goes to one shard under one lock.
+  auto& shard = shards_[get_local_cpu() % kShards];
+  {
+    std::lock_guard l{shard.mu};
+    for (auto& func : funcs) {
+      auto* task = new Task{Task::Opts{}.set_func(func).set_executor(this)};
+      push(shard, l, task, kNoDeadline);
+    }
+  }
+
+  refill_queues();
+}
+
+void EDFExecutorImpl::push(Task* task, int64_t deadline_nsec) {
+  auto& shard = shards_[get_local_cpu() % kShards];
+  {
+    std::lock_guard l{shard.mu};
+    push(shard, l, task, deadline_nsec);
+  }
+
+  refill_queues();
+}
+
+void EDFExecutorImpl::push(Shard& shard, const std::lock_guard<std::mutex>&,
+                           Task* task, int64_t deadline_nsec) {
+  task->set_state(Task::State::kQueuedExecutor);
+  THETA_PROBE2(post, this, task);
+
+  shard.heap.push(Entry{deadline_nsec, shard.next_seq++, task});
+  shard.earliest_nsec.store(shard.heap.top().deadline_nsec,
+                            std::memory_order::release);
+}
+
+std::unique_ptr<Task> EDFExecutorImpl::pop() {
+  // Another popper can empty the chosen shard first, so retry a bounded
+  // number of times before reporting that there is nothing to pop.
+  for (size_t attempt = 0; attempt < kShards; attempt++) {
+    Shard* best = nullptr;
+    int64_t best_nsec = kEmpty;
+    for (auto& shard : shards_) {
+      int64_t nsec = shard.earliest_nsec.load(std::memory_order::acquire);
+      if (nsec < best_nsec) {
+        best = &shard;
+        best_nsec = nsec;
+      }
+    }
+    if (!best) {
+      return nullptr;
+    }
+
+    Entry entry;
+    {
+      std::lock_guard l{best->mu};
+      if (best->heap.empty()) {
+        continue;
+      }
+      entry = best->heap.top();
+      best->heap.pop();
+      best->earliest_nsec.store(
+          best->heap.empty() ? kEmpty : best->heap.top().deadline_nsec,
+          std::memory_order::release);
+    }
+
+    return std::unique_ptr<Task>{entry.task};
+  }
+
+  return nullptr;
+}
+
+}  // namespace theta
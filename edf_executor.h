@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "executor.h"
+#include "queue.h"
+#include "task.h"
+
+namespace theta {
+
+// Runs the task with the earliest deadline first. A task whose deadline has
+// passed by the time a worker starts it runs its expire callback instead of
+// its func, so late work is shed instead of making the backlog later still.
+// Tasks posted without a deadline run after every task that has one.
+//
+// Posted tasks go into one of kShards binary heaps, each behind its own
+// mutex, picked by the posting CPU. Every shard publishes its earliest
+// deadline, and pop() takes from the shard with the earliest published
+// deadline. The order is therefore only approximately EDF while the shards
+// are being modified.
+class EDFExecutorImpl : public ExecutorImpl {
+  friend class ThrottlingThreadpool;
+
+ public:
+  static constexpr size_t kShards = 16;
+
+  ~EDFExecutorImpl() override;
+
+  void post(Func func) override;
+  void post_batch(std::vector<Func> funcs) override;
+  void post(Func func, std::chrono::time_point<Clock> deadline,
+            Func expireCallback = nullptr) override;
+
+  EDFExecutorImpl(const Executor::Opts& opts) : ExecutorImpl(opts) {}
+
+ protected:
+  std::unique_ptr<Task> pop() override;
+
+ private:
+  // The published deadline of a shard without tasks. Tasks without a
+  // deadline use kNoDeadline, which sorts before it.
+  static constexpr int64_t kEmpty = std::numeric_limits<int64_t>::max();
+  static constexpr int64_t kNoDeadline = kEmpty - 1;
+
+  struct Entry {
+    int64_t deadline_nsec;
+    // Breaks ties in post order.
+    uint64_t seq;
+    Task* task;
+
+    bool operator>(const Entry& other) const {
+      return deadline_nsec != other.deadline_nsec
+                 ? deadline_nsec > other.deadline_nsec
+                 : seq > other.seq;
+    }
+  };
+
+  struct alignas(hardware_destructive_interference_size) Shard {
+    std::mutex mu;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    uint64_t next_seq{0};
+    std::atomic<int64_t> earliest_nsec{kEmpty};
+  };
+
+  std::array<Shard, kShards> shards_;
+
+  void push(Task* task, int64_t deadline_nsec);
+  // Adds the task to the shard's heap and republishes its earliest
+  // deadline.
+  void push(Shard& shard, const std::lock_guard<std::mutex>&, Task* task,
+            int64_t deadline_nsec);
+};
+
+}  // namespace theta
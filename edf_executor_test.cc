@@ -0,0 +1,135 @@
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+Executor create_single_slot_executor() {
+  return ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::EarliestDeadlineFirst)
+          .set_thread_weight(1)
+          .set_worker_limit(1));
+}
+
+// Occupies the executor's only active slot until release() is called, so
+// that everything posted in the meantime queues up.
+class Blocker {
+ public:
+  explicit Blocker(Executor& executor) {
+    executor.post([this]() {
+      started_.count_down();
+      release_.wait();
+    });
+    started_.wait();
+  }
+
+  void release() { release_.count_down(); }
+
+ private:
+  std::latch started_{1};
+  std::latch release_{1};
+};
+
+}  // namespace
+
+TEST(EDFExecutor, runs_earliest_deadline_first) {
+  Executor executor = create_single_slot_executor();
+  Blocker blocker{executor};
+
+  auto now = Executor::Clock::now();
+  std::mutex mu;
+  std::vector<int> order;
+  std::latch done{6};
+  auto record = [&](int i) {
+    return [&, i]() {
+      {
+        std::lock_guard l{mu};
+        order.push_back(i);
+      }
+      done.count_down();
+    };
+  };
+
+  executor.post(record(5));
+  for (int i : {3, 0, 4, 1, 2}) {
+    executor.post(record(i), now + 1h + i * 1s);
+  }
+  blocker.release();
+  done.wait();
+
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4, 5}));
+}
+
+TEST(EDFExecutor, expired_tasks_run_the_expire_callback) {
+  Executor executor = create_single_slot_executor();
+  Blocker blocker{executor};
+
+  std::atomic<bool> ran{false};
+  std::atomic<bool> expired{false};
+  std::latch done{2};
+
+  executor.post(
+      [&]() {
+        ran.store(true);
+        done.count_down();
+      },
+      Executor::Clock::now() + 1ms,
+      [&]() {
+        expired.store(true);
+        done.count_down();
+      });
+  // Without a callback, an expired task is just dropped.
+  executor.post([&]() { ran.store(true); }, Executor::Clock::now() + 1ms);
+  executor.post([&]() { done.count_down(); }, Executor::Clock::now() + 1h);
+
+  std::this_thread::sleep_for(20ms);
+  blocker.release();
+  done.wait();
+
+  EXPECT_TRUE(expired.load());
+  EXPECT_FALSE(ran.load());
+}
+
+TEST(EDFExecutor, saturate_many_threads) {
+  static constexpr int kJobs = 100000;
+
+  auto num_threads = std::thread::hardware_concurrency();
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::EarliestDeadlineFirst)
+          .set_thread_weight(num_threads)
+          .set_worker_limit(Executor::Opts::kNoWorkerLimit));
+
+  std::latch work_done{kJobs};
+  auto job = [&]() { work_done.count_down(); };
+
+  std::vector<std::thread> posters;
+  auto deadline = Executor::Clock::now() + 1h;
+  for (unsigned t = 0; t < num_threads; t++) {
+    posters.emplace_back([&, t]() {
+      for (int i = t; i < kJobs; i += num_threads) {
+        executor.post(job, deadline + i * 1us);
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+
+  work_done.wait();
+}
+
+}  // namespace theta
@@ -2,12 +2,89 @@
 
 #include <glog/logging.h>
 #include <rseq/rseq.h>
+#include <sys/mman.h>
 
+#include <cstdint>
 #include <mutex>
+#include <new>
 #include <set>
 
 namespace theta {
 
+namespace {
+
+constexpr size_t kHugePageSize = 2 << 20;
+
+std::byte* map_pages(size_t size, int flags) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : static_cast<std::byte*>(ptr);
+}
+
+// Maps size bytes on a huge page boundary, so that the kernel can back all
+// of them with transparent huge pages. mmap only promises ordinary page
+// alignment, so this maps an extra huge page and trims the ends.
+std::byte* map_huge_aligned(size_t size) {
+  std::byte* ptr = map_pages(size + kHugePageSize, 0);
+  if (!ptr) {
+    return nullptr;
+  }
+  auto addr = reinterpret_cast<uintptr_t>(ptr);
+  size_t head = (kHugePageSize - addr % kHugePageSize) % kHugePageSize;
+  if (head) {
+    PCHECK(munmap(ptr, head) == 0);
+  }
+  PCHECK(munmap(ptr + head + size, kHugePageSize - head) == 0);
+  return ptr + head;
+}
+
+void populate_pages(std::byte* page, size_t size) {
+#if defined(MADV_POPULATE_WRITE)
+  if (madvise(page, size, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  // Kernels before 5.14 only populate at mmap time, which would fault in the
+  // ends that map_huge_aligned trims.
+  for (size_t offset = 0; offset < size; offset += kPageSize) {
+    reinterpret_cast<volatile std::byte*>(page)[offset] = std::byte{0};
+  }
+}
+
+}  // namespace
+
+std::byte* allocate_page(const PageOpts& opts) {
+  size_t size = opts.page_size();
+  bool huge = opts.huge_pages() != HugePages::kNone &&
+              size % kHugePageSize == 0;
+  int populate = opts.populate() ? MAP_POPULATE : 0;
+
+  if (huge && opts.huge_pages() == HugePages::kExplicit) {
+    if (std::byte* page = map_pages(size, MAP_HUGETLB | populate)) {
+      return page;
+    }
+    // The huge page pool is empty or was never reserved.
+  }
+
+  std::byte* page = huge ? map_huge_aligned(size) : map_pages(size, populate);
+  if (!page) {
+    throw std::bad_alloc{};
+  }
+  if (huge) {
+    // Fails when transparent huge pages are disabled, which leaves ordinary
+    // pages.
+    madvise(page, size, MADV_HUGEPAGE);
+    if (opts.populate()) {
+      populate_pages(page, size);
+    }
+  }
+  return page;
+}
+
+void free_page(std::byte* page, const PageOpts& opts) {
+  PCHECK(munmap(page, opts.page_size()) == 0);
+}
+
 size_t get_local_cpu() {
   thread_local int remainingUses = 0;
   thread_local size_t cpu = -1;
@@ -28,7 +105,8 @@ hsp::HyperSharedPointer<CPULocalMemoryPools> Epoch::get_allocator() {
   auto v = instance.pools_.get();
   int epoch_number = instance.epoch_number_.load(std::memory_order::relaxed);
 
-  if (v->pools_[v.originalCpu()].num_pages() >= 4) {
+  const auto& pool = v->pools_[v.originalCpu()];
+  if (pool.num_pages() >= pool.opts().pages_per_epoch()) {
     std::lock_guard lock{instance.mutex_};
     if (epoch_number == instance.epoch_number_.load(std::memory_order::acquire)) {
       instance.new_epoch_impl(lock);
@@ -41,6 +119,14 @@ hsp::HyperSharedPointer<CPULocalMemoryPools> Epoch::get_allocator() {
 /*static*/
 void Epoch::new_epoch() { get_instance().new_epoch_impl(); }
 
+/*static*/
+void Epoch::configure(const PageOpts& opts) {
+  auto& instance = get_instance();
+  std::lock_guard lock{instance.mutex_};
+  instance.opts_ = opts;
+  instance.new_epoch_impl(lock);
+}
+
 void Epoch::new_epoch_impl() {
   std::lock_guard lock{mutex_};
   new_epoch_impl(lock);
@@ -48,7 +134,7 @@ void Epoch::new_epoch_impl() {
 
 void Epoch::new_epoch_impl(const std::lock_guard<std::mutex>&) {
   auto old_epoch = pools_.get();
-  auto new_epoch = pools_.reset(new CPULocalMemoryPools{});
+  auto new_epoch = pools_.reset(new CPULocalMemoryPools{opts_});
   old_epoch->next_epoch_ = std::move(new_epoch);
   epoch_number_.fetch_add(1, std::memory_order_acq_rel);
 }
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
 #include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "HyperSharedPointer.h"
 
@@ -16,15 +20,73 @@ size_t get_local_cpu();
 class CPULocalMemoryPools;
 using AllocatorPointer = hsp::HyperSharedPointer<CPULocalMemoryPools>;
 
+// The smallest page, and the largest object that any MemoryPool can hold.
 static constexpr size_t kPageSize = 4096;
 
-struct alignas(kPageSize) Page {
-  std::array<std::byte, kPageSize> data;
+enum class HugePages {
+  // Ordinary pages.
+  kNone,
+  // Asks for transparent huge pages with madvise(MADV_HUGEPAGE). The kernel
+  // uses them when it has them, and ordinary pages otherwise.
+  kTransparent,
+  // Takes pages from the reserved huge page pool with MAP_HUGETLB, and falls
+  // back to kTransparent when the pool is empty or the page size is not a
+  // multiple of the huge page size.
+  kExplicit,
 };
 
+// How a MemoryPool gets the pages that it bumps through. Pages come straight
+// from mmap, so larger pages mean fewer allocations and fewer TLB misses.
+class PageOpts {
+ public:
+  // Rounded up to a multiple of kPageSize.
+  size_t page_size() const { return page_size_; }
+  PageOpts& set_page_size(size_t val) {
+    page_size_ = std::max(kPageSize, (val + kPageSize - 1) / kPageSize *
+                                         kPageSize);
+    return *this;
+  }
+
+  HugePages huge_pages() const { return huge_pages_; }
+  PageOpts& set_huge_pages(HugePages val) {
+    huge_pages_ = val;
+    return *this;
+  }
+
+  // Faults every page in when it is mapped, with MAP_POPULATE, so that the
+  // allocations that land on it never take a page fault.
+  bool populate() const { return populate_; }
+  PageOpts& set_populate(bool val) {
+    populate_ = val;
+    return *this;
+  }
+
+  // How many pages one CPU's pool fills before Epoch::get_allocator starts a
+  // new epoch. With larger pages, fewer are needed per epoch.
+  int pages_per_epoch() const { return pages_per_epoch_; }
+  PageOpts& set_pages_per_epoch(int val) {
+    pages_per_epoch_ = std::max(1, val);
+    return *this;
+  }
+
+ private:
+  size_t page_size_{kPageSize};
+  HugePages huge_pages_{HugePages::kNone};
+  bool populate_{false};
+  int pages_per_epoch_{4};
+};
+
+// Maps a page as opts describe, and throws std::bad_alloc if even ordinary
+// pages cannot be mapped.
+std::byte* allocate_page(const PageOpts& opts);
+void free_page(std::byte* page, const PageOpts& opts);
+
 class alignas(sizeof(__int128)) MemoryPool {
+  friend class CPULocalMemoryPools;
+
  public:
-  MemoryPool() {}
+  // The first page is only mapped by the first allocation.
+  explicit MemoryPool(PageOpts opts = {}) : opts_(opts) {}
 
   ~MemoryPool() {
     std::lock_guard lock{mutex_};
@@ -34,13 +96,17 @@ class alignas(sizeof(__int128)) MemoryPool {
       dtors_.pop_back();
     }
 
-    for (Page* page : old_pages_) {
-      delete page;
+    for (std::byte* page : old_pages_) {
+      free_page(page, opts_);
     }
 
-    delete d_.page.load(std::memory_order_relaxed);
+    if (std::byte* page = d_.page.load(std::memory_order_relaxed)) {
+      free_page(page, opts_);
+    }
   }
 
+  const PageOpts& opts() const { return opts_; }
+
   template <typename T, typename... Args>
   T* allocate(Args... args) {
     T* ptr = reinterpret_cast<T*>(allocate(sizeof(T), alignof(T)));
@@ -59,18 +125,23 @@ class alignas(sizeof(__int128)) MemoryPool {
         }
       }
 
-      if (want_offset > kPageSize) {
+      if (want_offset > opts_.page_size() ||
+          !data.page.load(std::memory_order_relaxed)) {
         std::lock_guard lock{mutex_};
         auto* old_page = data.page.load(std::memory_order_relaxed);
         data = d_;
         if (old_page == data.page.load(std::memory_order_relaxed)) {
-          old_pages_.push_back(old_page);
-          num_old_pages_.fetch_add(1, std::memory_order_relaxed);
-          data.page.store(new Page, std::memory_order_relaxed);
+          if (old_page) {
+            old_pages_.push_back(old_page);
+            num_old_pages_.fetch_add(1, std::memory_order_relaxed);
+          }
+          data.page.store(allocate_page(opts_), std::memory_order_relaxed);
           data.offset.store(0, std::memory_order_relaxed);
           d_.line.store(data.line.load(std::memory_order_relaxed),
                         std::memory_order_release);
         }
+        // The CAS below fails, since d_ moved on, and the loop retries on
+        // the new page.
       }
 
       data.offset.store(want_offset, std::memory_order_relaxed);
@@ -98,13 +169,14 @@ class alignas(sizeof(__int128)) MemoryPool {
   }
 
   int num_pages() const {
-    return 1 + num_old_pages_.load(std::memory_order_acquire);
+    int current = d_.page.load(std::memory_order_acquire) ? 1 : 0;
+    return current + num_old_pages_.load(std::memory_order_acquire);
   }
 
  private:
   union Data {
     struct {
-      std::atomic<Page*> page;
+      std::atomic<std::byte*> page;
       std::atomic<size_t> offset;
     };
     std::atomic<__int128> line;
@@ -120,14 +192,16 @@ class alignas(sizeof(__int128)) MemoryPool {
     }
 
     Data() {
-      page.store(new Page, std::memory_order_relaxed);
+      page.store(nullptr, std::memory_order_relaxed);
       offset.store(0, std::memory_order_relaxed);
     }
   } d_;
 
+  // Only set before the first allocation.
+  PageOpts opts_;
   std::atomic<int> num_old_pages_{0};
   std::mutex mutex_;
-  std::list<Page*> old_pages_;
+  std::list<std::byte*> old_pages_;
   std::list<std::function<void()>> dtors_;
 };
 
@@ -135,7 +209,12 @@ class CPULocalMemoryPools {
   friend class Epoch;
 
  public:
-  CPULocalMemoryPools() : pools_(std::thread::hardware_concurrency()) {}
+  explicit CPULocalMemoryPools(const PageOpts& opts = {})
+      : pools_(std::thread::hardware_concurrency()) {
+    for (auto& pool : pools_) {
+      pool.opts_ = opts;
+    }
+  }
 
   ~CPULocalMemoryPools() {
     std::atomic_thread_fence(std::memory_order::acquire);
@@ -173,12 +252,18 @@ class Epoch {
 
   static void new_epoch();
 
+  // Starts a new epoch whose pools, and those of every later epoch, get
+  // their pages as opts describe. Objects in older epochs keep their pages.
+  static void configure(const PageOpts& opts);
+
  private:
   static Epoch& get_instance();
 
   std::atomic<int> epoch_number_{0};
   hsp::KeepAlive<CPULocalMemoryPools> pools_{nullptr};
   std::mutex mutex_;
+  // Guarded by mutex_.
+  PageOpts opts_;
 
   Epoch() : pools_(new CPULocalMemoryPools{}) {}
 
@@ -0,0 +1,45 @@
+#include <cstddef>
+#include <cstring>
+
+#include "benchmark/benchmark.h"
+#include "epoch.h"
+
+namespace theta {
+
+// Each iteration fills a fresh pool with kBatch small objects and tears it
+// down, so it pays for mapping, faulting in and unmapping every page as well
+// as for the bump allocations themselves.
+static void BM_allocate(benchmark::State &state) {
+  static constexpr int kBatch = 1 << 16;
+  static constexpr size_t kObjectSize = 64;
+  PageOpts opts = PageOpts{}
+                      .set_page_size(state.range(0) << 10)
+                      .set_huge_pages(static_cast<HugePages>(state.range(1)))
+                      .set_populate(state.range(2));
+
+  for (auto _ : state) {
+    MemoryPool pool{opts};
+    for (int i = 0; i < kBatch; i++) {
+      void *ptr = pool.allocate(kObjectSize, alignof(std::max_align_t));
+      std::memset(ptr, 0, kObjectSize);
+      benchmark::DoNotOptimize(ptr);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+BENCHMARK(BM_allocate)
+    ->ArgNames({"page_kib", "huge_pages", "populate"})
+    ->Args({4, static_cast<int>(HugePages::kNone), 0})
+    ->Args({64, static_cast<int>(HugePages::kNone), 0})
+    ->Args({64, static_cast<int>(HugePages::kNone), 1})
+    ->Args({2048, static_cast<int>(HugePages::kNone), 0})
+    ->Args({2048, static_cast<int>(HugePages::kTransparent), 0})
+    ->Args({2048, static_cast<int>(HugePages::kTransparent), 1})
+    ->Args({2048, static_cast<int>(HugePages::kExplicit), 0})
+    ->Args({2048, static_cast<int>(HugePages::kExplicit), 1});
+
+}  // namespace theta
+
+BENCHMARK_MAIN();
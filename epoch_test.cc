@@ -2,10 +2,13 @@
 
 #include <glog/logging.h>
 
+#include <array>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -82,6 +85,99 @@ TEST(CPULocalMemoryPools, allocate) {
   }
 }
 
+TEST(MemoryPool, first_page_is_lazy) {
+  MemoryPool mp;
+  EXPECT_EQ(mp.num_pages(), 0);
+
+  mp.allocate(sizeof(int), alignof(int));
+  EXPECT_EQ(mp.num_pages(), 1);
+}
+
+TEST(PageOpts, page_size_rounds_up) {
+  EXPECT_EQ(PageOpts{}.page_size(), kPageSize);
+  EXPECT_EQ(PageOpts{}.set_page_size(0).page_size(), kPageSize);
+  EXPECT_EQ(PageOpts{}.set_page_size(kPageSize + 1).page_size(),
+            2 * kPageSize);
+  EXPECT_EQ(PageOpts{}.set_page_size(64 << 10).page_size(), 64 << 10);
+}
+
+TEST(MemoryPool, large_pages) {
+  static constexpr size_t kChunk = 1024;
+  static constexpr size_t kPage = 64 << 10;
+  MemoryPool mp{PageOpts{}.set_page_size(kPage)};
+
+  auto* first = static_cast<std::byte*>(mp.allocate(kChunk, 1));
+  for (size_t i = 1; i < kPage / kChunk; i++) {
+    EXPECT_EQ(mp.allocate(kChunk, 1), first + i * kChunk);
+  }
+  EXPECT_EQ(mp.num_pages(), 1);
+
+  mp.allocate(kChunk, 1);
+  EXPECT_EQ(mp.num_pages(), 2);
+}
+
+// Huge pages may be disabled or unreserved, in which case the pool falls back
+// to ordinary pages. Either way the memory works and the pages are aligned.
+TEST(MemoryPool, huge_pages) {
+  static constexpr size_t kHugePage = 2 << 20;
+  for (auto huge_pages : {HugePages::kTransparent, HugePages::kExplicit}) {
+    for (bool populate : {false, true}) {
+      MemoryPool mp{PageOpts{}
+                        .set_page_size(2 * kHugePage)
+                        .set_huge_pages(huge_pages)
+                        .set_populate(populate)};
+
+      std::vector<int*> vals;
+      for (int i = 0; i < (1 << 20) + 1; i++) {
+        vals.push_back(mp.allocate<int>(i));
+      }
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(vals.front()) % kHugePage, 0);
+      EXPECT_EQ(mp.num_pages(), 2);
+      for (int i = 0; i < static_cast<int>(vals.size()); i++) {
+        ASSERT_EQ(*vals[i], i);
+      }
+    }
+  }
+}
+
+TEST(MemoryPool, huge_pages_need_huge_page_size) {
+  MemoryPool mp{PageOpts{}
+                    .set_page_size(64 << 10)
+                    .set_huge_pages(HugePages::kExplicit)
+                    .set_populate(true)};
+
+  int* val = mp.allocate<int>(7);
+  EXPECT_EQ(*val, 7);
+}
+
+TEST(CPULocalMemoryPools, page_opts) {
+  static constexpr size_t kPage = 64 << 10;
+  CPULocalMemoryPools mp{PageOpts{}.set_page_size(kPage)};
+
+  using Chunk = std::array<std::byte, 1024>;
+  auto* first = mp.allocate_on_cpu<Chunk>(0);
+  for (size_t i = 1; i < kPage / sizeof(Chunk); i++) {
+    EXPECT_EQ(mp.allocate_on_cpu<Chunk>(0), first + i);
+  }
+}
+
+TEST(Epoch, configure) {
+  static constexpr size_t kPage = 64 << 10;
+  Epoch::configure(PageOpts{}.set_page_size(kPage).set_pages_per_epoch(2));
+
+  using Chunk = std::array<std::byte, 1024>;
+  {
+    auto allocator = Epoch::get_allocator();
+    auto* first = allocator->allocate_on_cpu<Chunk>(0);
+    for (size_t i = 1; i < kPage / sizeof(Chunk); i++) {
+      EXPECT_EQ(allocator->allocate_on_cpu<Chunk>(0), first + i);
+    }
+  }
+
+  // The later tests expect the defaults.
+  Epoch::configure(PageOpts{});
+}
+
 TEST(Epoch, delayed_dtor) {
   struct Foo {
     Foo(int d) : data(d) {}
@@ -2,37 +2,58 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cmath>
 
+#include "probes.h"
+#include "topology.h"
+
 namespace theta {
 
-int ExecutorStats::running_num(std::memory_order mem_order) const {
-  return running_num_.load(mem_order);
+void ExecutorStats::delta(std::atomic<int64_t> Counters::*counter, int val) {
+  (counters_.local().*counter).fetch_add(val, std::memory_order::relaxed);
 }
-void ExecutorStats::running_delta(int val) {
-  running_num_.fetch_add(val, std::memory_order::acq_rel);
+
+int ExecutorStats::sum(std::atomic<int64_t> Counters::*counter,
+                       std::memory_order mem_order) const {
+  int64_t total = 0;
+  counters_.for_each([&](const Counters& counters) {
+    total += (counters.*counter).load(mem_order);
+  });
+  return std::max<int64_t>(0, total);
 }
 
-int ExecutorStats::waiting_num(std::memory_order mem_order) const {
-  return waiting_num_.load(mem_order);
+int ExecutorStats::running_num(std::memory_order mem_order) const {
+  return sum(&Counters::running, mem_order);
 }
-void ExecutorStats::waiting_delta(int val) {
-  waiting_num_.fetch_add(val, std::memory_order::acq_rel);
+void ExecutorStats::running_delta(int val) { delta(&Counters::running, val); }
+
+int ExecutorStats::waiting_num(std::memory_order mem_order) const {
+  return sum(&Counters::waiting, mem_order);
 }
+void ExecutorStats::waiting_delta(int val) { delta(&Counters::waiting, val); }
 
 int ExecutorStats::throttled_num(std::memory_order mem_order) const {
-  return throttled_num_.load(mem_order);
+  return sum(&Counters::throttled, mem_order);
 }
 void ExecutorStats::throttled_delta(int val) {
-  throttled_num_.fetch_add(val, std::memory_order::acq_rel);
+  delta(&Counters::throttled, val);
 }
 
 int ExecutorStats::finished_num(std::memory_order mem_order) const {
-  return finished_num_.load(mem_order);
+  return sum(&Counters::finished, mem_order);
 }
-void ExecutorStats::finished_delta(int val) {
-  finished_num_.fetch_add(val, std::memory_order::acq_rel);
+void ExecutorStats::finished_delta(int val) { delta(&Counters::finished, val); }
+
+int ExecutorStats::expired_num(std::memory_order mem_order) const {
+  return sum(&Counters::expired, mem_order);
 }
+void ExecutorStats::expired_delta(int val) { delta(&Counters::expired, val); }
+
+int ExecutorStats::blocked_num(std::memory_order mem_order) const {
+  return sum(&Counters::blocked, mem_order);
+}
+void ExecutorStats::blocked_delta(int val) { delta(&Counters::blocked, val); }
 
 double ExecutorStats::ema_usage_proportion(std::memory_order mem_order) const {
   return ema_usage_proportion_.load(mem_order);
@@ -42,63 +63,66 @@ double ExecutorStats::ema_nivcsw_per_task(std::memory_order mem_order) const {
   return ema_nivcsw_per_task_.load(mem_order);
 }
 
-void ExecutorStats::update_ema(struct rusage* begin_ru,
-                               struct timeval* begin_tv, struct rusage* end_ru,
-                               struct timeval* end_tv) {
-  static constexpr double kTau = 1.0;  // I.e., average events per second.
+double ExecutorStats::ema_completions_per_sec(
+    std::memory_order mem_order) const {
+  return ema_completions_per_sec_.load(mem_order);
+}
 
-  auto tvInterval = [](struct timeval* start, struct timeval* end) {
-    double sec = ((end->tv_sec * 1000000 + end->tv_usec) -
-                  (start->tv_sec * 1000000 + start->tv_usec)) /
-                 1e6;
-    return sec / kTau;
-  };
+double ExecutorStats::ema_queue_wait_sec(std::memory_order mem_order) const {
+  return ema_queue_wait_sec_.load(mem_order);
+}
 
-  do {
-    double interval = tvInterval(begin_tv, end_tv);
-    if (interval <= 0.0) {
-      break;
-    }
+void ExecutorStats::fold_usage(const Usage& usage, double interval_sec,
+                               double tau_sec) {
+  if (interval_sec <= 0.0 || tau_sec <= 0.0) {
+    return;
+  }
 
-    double usage = tvInterval(&begin_ru->ru_utime, &end_ru->ru_utime);
-    //if (usage <= 0.0) {
-    //  break;
-    //}
+  double alpha = 1.0 - exp(-interval_sec / tau_sec);
 
-    double alpha = 1.0 - exp(-interval / kTau);
-    double proportion = std::min(1.0, usage == 0.0 ? 1.0 : usage / interval);
+  double completions_per_sec = usage.tasks / interval_sec;
+  double ema_completions = ema_completions_per_sec(std::memory_order::relaxed);
+  ema_completions_per_sec_.store(
+      ema_completions + alpha * (completions_per_sec - ema_completions),
+      std::memory_order::release);
 
-    double expected = ema_usage_proportion(std::memory_order::relaxed);
-    double desired;
-    do {
-      desired = expected + alpha * (proportion - expected);
-    } while (!ema_usage_proportion_.compare_exchange_weak(
-        expected, desired, std::memory_order::release,
-        std::memory_order::relaxed));
-  } while (0);
+  if (usage.tasks == 0) {
+    return;
+  }
 
-  do {
-    timeval last_update_tv = ema_last_update_.load(std::memory_order::acquire);
-    double interval = tvInterval(&last_update_tv, end_tv);
-    ema_last_update_.compare_exchange_strong(last_update_tv, *end_tv,
-                                             std::memory_order::release,
-                                             std::memory_order::relaxed);
-    if (last_update_tv.tv_sec == 0 || interval <= 0.0) {
-      break;
-    }
+  double queue_wait_sec = usage.queue_wait_sec / usage.tasks;
+  double ema_queue_wait = ema_queue_wait_sec(std::memory_order::relaxed);
+  ema_queue_wait_sec_.store(
+      ema_queue_wait + alpha * (queue_wait_sec - ema_queue_wait),
+      std::memory_order::release);
+
+  if (usage.wall_sec > 0.0) {
+    double proportion = std::min(
+        1.0, usage.utime_sec == 0.0 ? 1.0 : usage.utime_sec / usage.wall_sec);
+    double ema = ema_usage_proportion(std::memory_order::relaxed);
+    ema_usage_proportion_.store(ema + alpha * (proportion - ema),
+                                std::memory_order::release);
+  }
 
-    double alpha = 1.0 - exp(-interval / kTau);
-    int64_t delta_nivcsw =
-        std::min(0L, end_ru->ru_nivcsw - begin_ru->ru_nivcsw);
+  double nivcsw_per_task =
+      static_cast<double>(std::max(0L, usage.nivcsw)) / usage.tasks;
+  double ema = ema_nivcsw_per_task(std::memory_order::relaxed);
+  ema_nivcsw_per_task_.store(ema + alpha * (nivcsw_per_task - ema),
+                             std::memory_order::release);
+}
 
-    double expected = ema_nivcsw_per_task(std::memory_order::relaxed);
-    double desired;
-    do {
-      desired = expected + alpha * (delta_nivcsw - expected);
-    } while (!ema_nivcsw_per_task_.compare_exchange_weak(expected, desired,
-                                                std::memory_order::release,
-                                                std::memory_order::relaxed));
-  } while (0);
+Histogram ExecutorStats::queue_delay_usec() const {
+  return queue_delay_usec_.snapshot();
+}
+void ExecutorStats::record_queue_delay_usec(uint64_t usec) {
+  queue_delay_usec_.record(usec);
+}
+
+Histogram ExecutorStats::run_time_usec() const {
+  return run_time_usec_.snapshot();
+}
+void ExecutorStats::record_run_time_usec(uint64_t usec) {
+  run_time_usec_.record(usec);
 }
 
 std::string ExecutorStats::debug_string() const {
@@ -111,8 +135,15 @@ std::string ExecutorStats::debug_string() const {
   s += ", throttled=" + std::to_string(throttled);
   s += ", total=" + std::to_string(total);
   s += ", finished=" + std::to_string(finished_num());
+  s += ", expired=" + std::to_string(expired_num());
+  s += ", blocked=" + std::to_string(blocked_num());
   s += ", ema_usage_proportion=" + std::to_string(ema_usage_proportion());
   s += ", ema_nivcsw_per_task=" + std::to_string(ema_nivcsw_per_task());
+  s += ", ema_completions_per_sec=" +
+       std::to_string(ema_completions_per_sec());
+  s += ", ema_queue_wait_sec=" + std::to_string(ema_queue_wait_sec());
+  s += ", queue_delay_usec=" + queue_delay_usec().debug_string();
+  s += ", run_time_usec=" + run_time_usec().debug_string();
   s += "}";
   return s;
 }
@@ -138,30 +169,153 @@ std::string ExecutorImpl::debug_string() const {
   return s;
 }
 
-void ExecutorImpl::refill_queues(Task** take_first) {
-  if (take_first) {
-    *take_first = nullptr;
-  }
+ExecutorSnapshot ExecutorImpl::snapshot() const {
+  auto opts = this->opts();
+  auto [active_num, active_limit] = active_num_limit();
+  return ExecutorSnapshot{
+      .name = opts->name(),
+      .thread_weight = opts->thread_weight(),
+      .worker_limit = opts->worker_limit(),
+      .active_num = active_num,
+      .active_limit = active_limit,
+      .running_limit = throttle_list_.running_limit(),
+      .waiting_num = stats_.waiting_num(),
+      .running_num = stats_.running_num(),
+      .throttled_num = stats_.throttled_num(),
+      .finished_num = stats_.finished_num(),
+      .expired_num = stats_.expired_num(),
+      .blocked_num = stats_.blocked_num(),
+      .ema_usage_proportion = stats_.ema_usage_proportion(),
+      .ema_nivcsw_per_task = stats_.ema_nivcsw_per_task(),
+      .ema_completions_per_sec = stats_.ema_completions_per_sec(),
+      .ema_queue_wait_sec = stats_.ema_queue_wait_sec(),
+      .queue_delay_usec = stats_.queue_delay_usec(),
+      .run_time_usec = stats_.run_time_usec(),
+  };
+}
 
-  refresh_limits();
+TimerId ExecutorImpl::post_at(TimerService::Clock::time_point deadline,
+                              TimerService::Clock::duration period,
+                              Func func) {
+  auto opts = this->opts();
+  CHECK(opts->timers()) << "Executor was not created by a threadpool";
+  return opts->timers()->schedule(this, deadline, period, std::move(func));
+}
+
+bool ExecutorImpl::cancel(TimerId id) {
+  auto opts = this->opts();
+  CHECK(opts->timers()) << "Executor was not created by a threadpool";
+  return opts->timers()->cancel(id);
+}
+
+void ExecutorImpl::refill_queues(std::vector<Task*>* batch) {
+  auto opts = this->opts();
+  size_t max_batch = batch ? batch->size() + opts->max_batch() : 0;
 
   // Queue more tasks to run
-  while (reserve_active()) {
+  while (true) {
+    if (!reserve_active()) {
+      // Whoever frees a slot next refills, or sees the flag and puts the
+      // executor on the ready list. A slot that was freed before the flag
+      // was set is seen by the check below.
+      if (!admission_missed_.load(std::memory_order::relaxed)) {
+        admission_missed_.store(true, std::memory_order::relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order::seq_cst);
+      auto [active_num, active_limit] = active_num_limit();
+      if (active_num < active_limit) {
+        continue;
+      }
+      return;
+    }
+
     std::unique_ptr<Task> task = pop();
     if (!task) {
       unreserve_active();
+      // The slot that this held may have turned away another refill that
+      // raced with a post.
+      std::atomic_thread_fence(std::memory_order::seq_cst);
+      if (admission_missed_.load(std::memory_order::relaxed) &&
+          admission_missed_.exchange(false, std::memory_order::acq_rel)) {
+        continue;
+      }
       return;
     }
-
-    if (take_first && !*take_first) {
-      *take_first = task.release();
+    task->holds_active_ = true;
+    task->queue_index_ = queue_index(*opts, task.get());
+    THETA_PROBE2(admit, this, task.get());
+
+    // Only skip the run queue when no other executor is waiting on it, or
+    // this executor would keep the worker to itself.
+    RunQueue* run_queue = opts->run_queues()[task->queue_index_];
+    if (batch && batch->size() < max_batch && run_queue->size() == 0) {
+      batch->push_back(task.release());
     } else {
       task->set_state(Task::State::kQueuedThreadpool);
-      opts().run_queue()->push(std::move(task));
+      run_queue->push(lanes_[task->queue_index_].get(), std::move(task));
     }
   }
 }
 
+void ExecutorImpl::release_batch(std::span<Task* const> tasks) {
+  auto opts = this->opts();
+  for (Task* task : tasks) {
+    task->set_state(Task::State::kQueuedThreadpool);
+    opts->run_queues()[task->queue_index_]->push(
+        lanes_[task->queue_index_].get(), std::unique_ptr<Task>{task});
+  }
+}
+
+void ExecutorImpl::maybe_mark_ready() {
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+  if (!admission_missed_.load(std::memory_order::relaxed)) {
+    return;
+  }
+  // An executor that is still at its limit gets another look from whoever
+  // frees the next slot, so backlogged executors cost nothing here.
+  auto [active_num, active_limit] = active_num_limit();
+  if (active_num < active_limit &&
+      admission_missed_.exchange(false, std::memory_order::acq_rel)) {
+    // The admitted tasks still go to their own queues.
+    auto opts = this->opts();
+    int node = opts->preferred_node();
+    size_t index = queue_of(
+        *opts, node == ExecutorOpts::kFollowPoster ? get_local_node() : node);
+    opts->run_queues()[index]->mark_ready(lanes_[index].get());
+  }
+}
+
+/*static*/
+size_t ExecutorImpl::queue_index(const Opts& opts, const Task* task) {
+  int node = opts.preferred_node();
+  return queue_of(opts, node == ExecutorOpts::kFollowPoster ? task->post_node_
+                                                            : node);
+}
+
+/*static*/
+size_t ExecutorImpl::queue_of(const Opts& opts, int node) {
+  const auto& queue_of_node = opts.queue_of_node();
+  if (node < 0 || static_cast<size_t>(node) >= queue_of_node.size()) {
+    return 0;
+  }
+  return queue_of_node[node];
+}
+
+void ExecutorImpl::update_opts(const std::function<void(Opts&)>& f) {
+  auto opts = opts_.update([&](Opts& next) {
+    auto policy = next.priority_policy();
+    f(next);
+    CHECK(next.priority_policy() == policy)
+        << "The priority policy of a live executor cannot change";
+    CHECK(next.worker_limit() != Opts::kNoWorkerLimit)
+        << "A live executor needs an explicit worker_limit";
+  });
+
+  for (auto& lane : lanes_) {
+    lane->set_weight(opts->thread_weight());
+  }
+}
+
 bool ExecutorImpl::reserve_active() {
   uint64_t expected = active_.line.load(std::memory_order::acquire);
   Active desired{0};
@@ -194,20 +348,43 @@ std::pair<int, int> ExecutorImpl::active_num_limit(
           a.limit.load(std::memory_order::relaxed)};
 }
 
-void ExecutorImpl::refresh_limits() {
-  int concurrency = std::thread::hardware_concurrency();
-  size_t active_limit =
-      concurrency / stats_.ema_usage_proportion(std::memory_order::acquire);
-  set_active_limit(std::min(active_limit, opts_.worker_limit()));
+void ExecutorImpl::refresh_limits(double cpu_share, double interval_sec) {
+  auto opts = this->opts();
+  ControllerInputs inputs{
+      .interval_sec = interval_sec,
+      .cpu_share = cpu_share,
+      .usage_proportion =
+          stats_.ema_usage_proportion(std::memory_order::acquire),
+      .completions_per_sec =
+          stats_.ema_completions_per_sec(std::memory_order::acquire),
+      .queue_wait_sec = stats_.ema_queue_wait_sec(std::memory_order::acquire),
+      .queue_depth = static_cast<size_t>(stats_.waiting_num()),
+      .active_limit = static_cast<size_t>(active_num_limit().second),
+      .worker_limit = opts->worker_limit(),
+  };
+  size_t worker_limit = std::max<size_t>(1, opts->worker_limit());
+  set_active_limit(
+      std::clamp<size_t>(controller_->active_limit(inputs), 1, worker_limit));
 
   double ema_nivcsw_per_task =
       stats_.ema_nivcsw_per_task(std::memory_order::acquire);
   if (ema_nivcsw_per_task > 0.0) {
     double tasks_per_interrupt = 1.0 / ema_nivcsw_per_task;
-    throttle_list_.set_running_limit(std::min(
-        opts_.worker_limit(), std::max(static_cast<size_t>(tasks_per_interrupt),
-                                       opts_.thread_weight())));
+    throttle_list_.set_running_limit(
+        std::min(opts->worker_limit(),
+                 std::max(static_cast<size_t>(tasks_per_interrupt),
+                          opts->thread_weight())));
   }
+
+  THETA_PROBE3(limits, this, active_num_limit().second,
+               throttle_list_.running_limit());
+}
+
+double ExecutorImpl::cpu_demand() const {
+  size_t tasks = stats_.waiting_num() + stats_.running_num() +
+                 stats_.throttled_num();
+  return std::min(tasks, opts()->worker_limit()) *
+         stats_.ema_usage_proportion(std::memory_order::acquire);
 }
 
 Executor::Executor(ExecutorImpl* impl) : impl_(impl) {}
@@ -9,13 +9,23 @@ static_assert(false);
 #include <sys/time.h>
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
-
+#include <span>
+#include <vector>
+
+#include "controller.h"
+#include "histogram.h"
+#include "per_cpu.h"
+#include "run_queue.h"
+#include "snapshot.h"
+#include "stats_reporter.h"
 #include "task.h"
+#include "timer_wheel.h"
 #include "worker.h"
 
 namespace theta {
@@ -38,10 +48,7 @@ class FIFOExecutorImpl;
 
 class ExecutorStats {
  public:
-  ExecutorStats() {
-    ema_last_update_.store(timeval{.tv_sec = 0, .tv_usec = 0},
-                           std::memory_order::relaxed);
-  }
+  ExecutorStats() {}
 
   int waiting_num(
       std::memory_order mem_order = std::memory_order::relaxed) const;
@@ -59,25 +66,68 @@ class ExecutorStats {
       std::memory_order mem_order = std::memory_order::relaxed) const;
   void finished_delta(int val);
 
+  // Tasks that ran their expire_func instead of their func.
+  int expired_num(
+      std::memory_order mem_order = std::memory_order::relaxed) const;
+  void expired_delta(int val);
+
+  // Tasks inside of a ScopedBlocking region. These are also counted as
+  // running or throttled.
+  int blocked_num(
+      std::memory_order mem_order = std::memory_order::relaxed) const;
+  void blocked_delta(int val);
+
   double ema_usage_proportion(
       std::memory_order mem_order = std::memory_order::relaxed) const;
   double ema_nivcsw_per_task(
       std::memory_order mem_order = std::memory_order::relaxed) const;
-  void update_ema(struct rusage* begin_ru, struct timeval* begin_tv,
-                  struct rusage* end_ru, struct timeval* end_tv);
+  double ema_completions_per_sec(
+      std::memory_order mem_order = std::memory_order::relaxed) const;
+  double ema_queue_wait_sec(
+      std::memory_order mem_order = std::memory_order::relaxed) const;
+  // Only called by the scaler thread, so the EMAs have a single writer.
+  // interval_sec is the wall time since the previous fold, and tau_sec is the
+  // EMA time constant.
+  void fold_usage(const Usage& usage, double interval_sec, double tau_sec);
+
+  // Microseconds from post until a worker starts the task.
+  Histogram queue_delay_usec() const;
+  void record_queue_delay_usec(uint64_t usec);
+
+  // Microseconds from when a worker starts the task until it returns.
+  Histogram run_time_usec() const;
+  void record_run_time_usec(uint64_t usec);
 
   std::string debug_string() const;
 
  private:
-  std::atomic<uint32_t> waiting_num_{0};
-  std::atomic<uint32_t> running_num_{0};
-  std::atomic<uint32_t> throttled_num_{0};
+  // Every task state transition updates these from whichever thread made
+  // it, so each CPU counts into its own cache line and reads add up the
+  // copies. A single copy can go negative when a task is counted in on one
+  // CPU and out on another.
+  struct Counters {
+    std::atomic<int64_t> waiting{0};
+    std::atomic<int64_t> running{0};
+    std::atomic<int64_t> throttled{0};
+    std::atomic<int64_t> finished{0};
+    std::atomic<int64_t> expired{0};
+    std::atomic<int64_t> blocked{0};
+  };
+  PerCpu<Counters> counters_;
 
-  std::atomic<uint64_t> finished_num_{0};
+  void delta(std::atomic<int64_t> Counters::*counter, int val);
+  // A read that races with a transition can see a task counted out on one
+  // CPU but not yet counted in on another, so this clamps at zero.
+  int sum(std::atomic<int64_t> Counters::*counter,
+          std::memory_order mem_order) const;
 
   std::atomic<double> ema_usage_proportion_{1.0};
   std::atomic<double> ema_nivcsw_per_task_{0.0};
-  std::atomic<timeval> ema_last_update_;
+  std::atomic<double> ema_completions_per_sec_{0.0};
+  std::atomic<double> ema_queue_wait_sec_{0.0};
+
+  ConcurrentHistogram queue_delay_usec_;
+  ConcurrentHistogram run_time_usec_;
 };
 
 class ExecutorOpts {
@@ -87,6 +137,15 @@ class ExecutorOpts {
 
  public:
   static constexpr size_t kNoWorkerLimit = 0;
+  static constexpr int kFollowPoster = -1;
+
+  // Identifies the executor in stats reports. Defaults to "executor<N>" in
+  // creation order.
+  const std::string& name() const { return name_; }
+  ExecutorOpts& set_name(std::string val) {
+    name_ = std::move(val);
+    return *this;
+  }
 
   PriorityPolicy priority_policy() const { return priority_policy_; }
   ExecutorOpts& set_priority_policy(PriorityPolicy val) {
@@ -106,21 +165,93 @@ class ExecutorOpts {
     return *this;
   }
 
+  // The time constant of the EMAs in ExecutorStats. A shorter tau reacts
+  // faster to a change in the workload but is noisier.
+  std::chrono::milliseconds ema_tau() const { return ema_tau_; }
+  ExecutorOpts& set_ema_tau(std::chrono::milliseconds val) {
+    ema_tau_ = val;
+    return *this;
+  }
+
+  // The most tasks that a worker claims from this executor at once, to run
+  // back to back instead of going through the shared run queue after each
+  // one. Tasks are only batched while no other executor is waiting on the
+  // run queue, and a batch never holds more than the active limit. Defaults
+  // to 1, which claims just the next task.
+  size_t max_batch() const { return max_batch_; }
+  ExecutorOpts& set_max_batch(size_t val) {
+    max_batch_ = val;
+    return *this;
+  }
+
+  // How long a worker may keep running a batch before it hands the rest
+  // back to the run queue, so that a batch of slow tasks does not hold up
+  // the tasks that other workers could have run.
+  std::chrono::microseconds batch_time_slice() const {
+    return batch_time_slice_;
+  }
+  ExecutorOpts& set_batch_time_slice(std::chrono::microseconds val) {
+    batch_time_slice_ = val;
+    return *this;
+  }
+
+  // The NUMA node whose workers run this executor's tasks, e.g. the node
+  // that holds the data they work on. kFollowPoster, the default, runs each
+  // task on the node of the thread that posted it, which is where its
+  // captures were allocated. Either way, a worker of another node only takes
+  // a task when the task's node has no worker to spare. A node that the
+  // pool has no workers on falls back to the first node that it has.
+  int preferred_node() const { return preferred_node_; }
+  ExecutorOpts& set_preferred_node(int val) {
+    preferred_node_ = val;
+    return *this;
+  }
+
+  // Creates the controller that picks the executor's active limit. Defaults
+  // to UsageController.
+  const ControllerFactory& controller_factory() const {
+    return controller_factory_;
+  }
+  ExecutorOpts& set_controller_factory(ControllerFactory val) {
+    controller_factory_ = std::move(val);
+    return *this;
+  }
+
  protected:
-  TaskQueue<>* run_queue() const { return run_queue_; }
-  ExecutorOpts& set_run_queue(TaskQueue<>* val) {
-    run_queue_ = val;
+  // The pool's run queues, one per NUMA node that it has workers on.
+  const std::vector<RunQueue*>& run_queues() const { return run_queues_; }
+  // Indexed by node id. Nodes without a run queue map to the first one.
+  const std::vector<size_t>& queue_of_node() const { return queue_of_node_; }
+  ExecutorOpts& set_run_queues(std::vector<RunQueue*> queues,
+                               std::vector<size_t> queue_of_node) {
+    run_queues_ = std::move(queues);
+    queue_of_node_ = std::move(queue_of_node);
+    return *this;
+  }
+
+  TimerService* timers() const { return timers_; }
+  ExecutorOpts& set_timers(TimerService* val) {
+    timers_ = val;
     return *this;
   }
 
  private:
+  std::string name_;
   PriorityPolicy priority_policy_{PriorityPolicy::FIFO};
   size_t thread_weight_{1};
   size_t worker_limit_{0};
-  TaskQueue<>* run_queue_{nullptr};
+  std::chrono::milliseconds ema_tau_{1000};
+  size_t max_batch_{1};
+  std::chrono::microseconds batch_time_slice_{500};
+  int preferred_node_{kFollowPoster};
+  ControllerFactory controller_factory_{nullptr};
+  std::vector<RunQueue*> run_queues_;
+  std::vector<size_t> queue_of_node_;
+  TimerService* timers_{nullptr};
 };
 
 class ExecutorImpl {
+  friend class ScopedBlocking;
   friend class ThrottlingThreadpool;
   friend class Worker;
   friend class Task;
@@ -128,7 +259,7 @@ class ExecutorImpl {
  public:
   using Func = Task::Func;
   using Opts = ExecutorOpts;
-  using Clock = std::chrono::high_resolution_clock;
+  using Clock = Task::Clock;
 
   static void get_tv(timeval* tv);
 
@@ -136,11 +267,30 @@ class ExecutorImpl {
 
   ExecutorImpl(Opts opts)
       : opts_(std::move(opts)),
-        active_(/*num_=*/0, /*limit_=*/opts_.worker_limit()),
+        active_(/*num_=*/0, /*limit_=*/opts_->worker_limit()),
         throttle_list_(
-            /*modification_queue_size=*/std::max(64UL, opts_.worker_limit())) {}
+            /*modification_queue_size=*/std::max(64UL, opts_->worker_limit())),
+        controller_(opts_->controller_factory()
+                        ? opts_->controller_factory()()
+                        : std::make_unique<UsageController>()) {
+    // Every lane admits all of the executor's tasks, whichever queue they
+    // go to.
+    for (size_t i = 0; i < std::max<size_t>(1, opts_->run_queues().size());
+         i++) {
+      lanes_.push_back(std::make_unique<RunQueue::Lane>(
+          opts_->thread_weight(), [this]() { refill_queues(); }));
+    }
+  }
 
-  const Opts& opts() const { return opts_; }
+  // The current options. The returned version stays valid for as long as
+  // the Ref, even if the options are updated in the meantime.
+  Snapshot<Opts>::Ref opts() const { return opts_.get(); }
+
+  // Applies f to a copy of the options and publishes it. worker_limit and
+  // ema_tau take effect at the next scaler pass, and the rest with the next
+  // task. The priority policy cannot change, worker_limit cannot go back to
+  // kNoWorkerLimit, and the controller is only created once.
+  void update_opts(const std::function<void(Opts&)>& f);
 
   virtual void post(Func func) { throw NotImplemented{}; }
 
@@ -151,6 +301,21 @@ class ExecutorImpl {
     throw NotImplemented{};
   }
 
+  // Posts funcs that became due together, e.g. expired timers. The built-in
+  // executors queue all of them before admitting any, so a batch costs one
+  // refill_queues() pass. The default posts them one at a time.
+  virtual void post_batch(std::vector<Func> funcs) {
+    for (auto& func : funcs) {
+      post(std::move(func));
+    }
+  }
+
+  // Posts func once deadline has passed, and then every period after it
+  // when period is non-zero.
+  TimerId post_at(TimerService::Clock::time_point deadline,
+                  TimerService::Clock::duration period, Func func);
+  bool cancel(TimerId id);
+
   virtual std::unique_ptr<Task> pop() = 0;
 
   ExecutorStats* stats() { return &stats_; }
@@ -158,8 +323,20 @@ class ExecutorImpl {
 
   std::string debug_string() const;
 
+  // Copies the stats and limits for a StatsReporter.
+  ExecutorSnapshot snapshot() const;
+
  protected:
-  void refill_queues(Task** take_first = nullptr);
+  // Admits tasks up to the active limit and queues them on the run queue.
+  // A worker that passes a batch gets up to max_batch of them appended to
+  // it instead, to run itself.
+  void refill_queues(std::vector<Task*>* batch = nullptr);
+  // Queues the tasks of a batch that a worker did not get to.
+  void release_batch(std::span<Task* const> tasks);
+  // Puts the executor on the run queue's ready list if a refill was turned
+  // away at the active limit since the last one that drained it. For paths
+  // that free an active slot without refilling.
+  void maybe_mark_ready();
 
  private:
   union Active {
@@ -180,19 +357,37 @@ class ExecutorImpl {
   };
   static_assert(sizeof(Active) == sizeof(Active::line), "");
 
-  const Opts opts_;
+  Snapshot<Opts> opts_;
   Active active_;
+  // Set when a refill stops at the active limit, so tasks may be queued
+  // that nobody is about to admit.
+  std::atomic<bool> admission_missed_{false};
   ThrottleList throttle_list_;
+  // One per run queue, in the same order.
+  std::vector<std::unique_ptr<RunQueue::Lane>> lanes_;
+  std::unique_ptr<ConcurrencyController> controller_;
 
   ExecutorStats stats_;
 
+  // The run queue of the task's preferred node, or of its poster's node.
+  // Callers pass the options that they already hold, so that a refill reads
+  // them once.
+  static size_t queue_index(const Opts& opts, const Task* task);
+  static size_t queue_of(const Opts& opts, int node);
+
   bool reserve_active();
   void unreserve_active();
   void set_active_limit(uint32_t val);
   std::pair<int, int> active_num_limit(
       std::memory_order mem_order = std::memory_order::relaxed) const;
 
-  void refresh_limits();
+  // Recomputes the active and running limits from the stats. This is only
+  // called by the scaler; the hot path just reads the published limits.
+  // cpu_share is the number of CPUs that this executor may use, which the
+  // scaler splits between executors by thread_weight.
+  void refresh_limits(double cpu_share, double interval_sec);
+  // How many CPUs this executor could keep busy with the tasks it has now.
+  double cpu_demand() const;
 };
 
 class Executor {
@@ -208,7 +403,12 @@ class Executor {
 
   virtual ~Executor() {}
 
-  const Opts& opts() { return impl_->opts(); }
+  Snapshot<Opts>::Ref opts() { return impl_->opts(); }
+
+  // Retunes the executor while it runs. See ExecutorImpl::update_opts.
+  void update_opts(const std::function<void(Opts&)>& f) {
+    impl_->update_opts(f);
+  }
 
   void post(Func func) { return impl_->post(func); }
 
@@ -219,6 +419,31 @@ class Executor {
     return impl_->post(func, deadline, expireCallback);
   }
 
+  // Delayed and periodic posts. The pool's timing wheel posts func to this
+  // executor when it is due, with a resolution of TimerService::kTick. The
+  // returned id can be passed to cancel().
+  TimerId post_after(Clock::duration delay, Func func) {
+    return impl_->post_at(TimerService::Clock::now() + delay,
+                          TimerService::Clock::duration::zero(),
+                          std::move(func));
+  }
+
+  TimerId post_at(std::chrono::time_point<Clock> time, Func func) {
+    return post_after(time - Clock::now(), std::move(func));
+  }
+
+  // The first run is one period from now. Runs that would fall behind, e.g.
+  // because the timer thread was descheduled, are skipped rather than run
+  // back to back.
+  TimerId post_every(Clock::duration period, Func func) {
+    return impl_->post_at(TimerService::Clock::now() + period, period,
+                          std::move(func));
+  }
+
+  // Returns false if the timer already fired or was cancelled. A periodic
+  // timer may run once more if it was already due.
+  bool cancel(TimerId id) { return impl_->cancel(id); }
+
  private:
   Executor(ExecutorImpl* impl);
 
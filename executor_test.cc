@@ -0,0 +1,78 @@
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <latch>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+TEST(Executor, update_opts_retunes_a_live_executor) {
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::FIFO)
+          .set_thread_weight(1)
+          .set_worker_limit(1));
+  auto old_opts = executor.opts();
+
+  executor.update_opts([](Executor::Opts& opts) {
+    opts.set_thread_weight(3).set_worker_limit(4).set_max_batch(8);
+  });
+
+  EXPECT_EQ(executor.opts()->thread_weight(), 3);
+  EXPECT_EQ(executor.opts()->worker_limit(), 4);
+  EXPECT_EQ(executor.opts()->max_batch(), 8);
+  EXPECT_EQ(executor.opts()->priority_policy(), PriorityPolicy::FIFO);
+  // Whoever read the old version can still use it.
+  EXPECT_EQ(old_opts->thread_weight(), 1);
+  EXPECT_EQ(old_opts->worker_limit(), 1);
+
+  std::latch done{1};
+  executor.post([&]() { done.count_down(); });
+  done.wait();
+}
+
+TEST(Executor, batches_stay_within_the_active_limit) {
+  static constexpr int kJobs = 10000;
+  static constexpr int kWorkerLimit = 2;
+
+  for (auto policy :
+       {PriorityPolicy::FIFO, PriorityPolicy::LIFO,
+        PriorityPolicy::EarliestDeadlineFirst,
+        PriorityPolicy::ExplicitPriority}) {
+    for (auto time_slice : {0us, 1000us}) {
+      Executor executor = ThrottlingThreadpool::getInstance().create(
+          Executor::Opts{}
+              .set_priority_policy(policy)
+              .set_thread_weight(1)
+              .set_worker_limit(kWorkerLimit)
+              .set_max_batch(16)
+              .set_batch_time_slice(time_slice));
+
+      std::atomic<int> running{0};
+      std::atomic<int> max_running{0};
+      std::latch done{kJobs};
+      for (int i = 0; i < kJobs; i++) {
+        executor.post([&]() {
+          int now = running.fetch_add(1) + 1;
+          int max = max_running.load();
+          while (now > max && !max_running.compare_exchange_weak(max, now)) {
+          }
+          running.fetch_sub(1);
+          done.count_down();
+        });
+      }
+      done.wait();
+
+      EXPECT_LE(max_running.load(), kWorkerLimit)
+          << "policy " << static_cast<int>(policy) << ", time slice "
+          << time_slice.count() << "us";
+    }
+  }
+}
+
+}  // namespace theta
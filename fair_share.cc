@@ -0,0 +1,61 @@
+#include "fair_share.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace theta {
+
+std::vector<double> weighted_fair_shares(double capacity,
+                                         const std::vector<double>& demands,
+                                         const std::vector<double>& weights) {
+  CHECK_EQ(demands.size(), weights.size());
+
+  std::vector<double> shares(demands.size(), 0.0);
+  std::vector<size_t> unsatisfied;
+  for (size_t i = 0; i < demands.size(); i++) {
+    if (demands[i] > 0.0) {
+      unsatisfied.push_back(i);
+    }
+  }
+
+  double remaining = capacity;
+  while (!unsatisfied.empty() && remaining > 0.0) {
+    double total_weight = 0.0;
+    for (size_t i : unsatisfied) {
+      total_weight += std::max(1.0, weights[i]);
+    }
+
+    // Everyone whose demand fits in their fair share is satisfied, which frees
+    // up capacity for the rest.
+    std::vector<size_t> still_unsatisfied;
+    double used = 0.0;
+    for (size_t i : unsatisfied) {
+      double fair = remaining * std::max(1.0, weights[i]) / total_weight;
+      if (demands[i] <= fair) {
+        shares[i] = demands[i];
+        used += demands[i];
+      } else {
+        still_unsatisfied.push_back(i);
+      }
+    }
+
+    if (still_unsatisfied.size() == unsatisfied.size()) {
+      for (size_t i : unsatisfied) {
+        shares[i] = remaining * std::max(1.0, weights[i]) / total_weight;
+      }
+      return shares;
+    }
+
+    remaining -= used;
+    unsatisfied = std::move(still_unsatisfied);
+  }
+
+  // Every demand fit, so nobody is competing for what is left.
+  for (double& share : shares) {
+    share += std::max(0.0, remaining);
+  }
+  return shares;
+}
+
+}  // namespace theta
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+namespace theta {
+
+// Splits capacity between consumers in proportion to their weights, without
+// giving anyone more than they demand (weighted max-min fairness). Capacity
+// that is left over once every demand is met is offered to every consumer on
+// top of its allocation, so the split only constrains anyone while the
+// consumers are actually competing.
+//
+// demands and weights must be the same size. Weights are clamped to be at
+// least 1.
+std::vector<double> weighted_fair_shares(double capacity,
+                                         const std::vector<double>& demands,
+                                         const std::vector<double>& weights);
+
+}  // namespace theta
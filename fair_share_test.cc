@@ -0,0 +1,40 @@
+#include "fair_share.h"
+
+#include <glog/logging.h>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+TEST(WeightedFairShares, proportional_under_contention) {
+  auto shares = weighted_fair_shares(/*capacity=*/7.0,
+                                     /*demands=*/{100.0, 100.0, 100.0},
+                                     /*weights=*/{1.0, 2.0, 4.0});
+  EXPECT_DOUBLE_EQ(shares[0], 1.0);
+  EXPECT_DOUBLE_EQ(shares[1], 2.0);
+  EXPECT_DOUBLE_EQ(shares[2], 4.0);
+}
+
+TEST(WeightedFairShares, small_demand_is_redistributed) {
+  auto shares = weighted_fair_shares(/*capacity=*/8.0,
+                                     /*demands=*/{1.0, 100.0, 100.0},
+                                     /*weights=*/{4.0, 1.0, 1.0});
+  EXPECT_DOUBLE_EQ(shares[0], 1.0);
+  EXPECT_DOUBLE_EQ(shares[1], 3.5);
+  EXPECT_DOUBLE_EQ(shares[2], 3.5);
+}
+
+TEST(WeightedFairShares, work_conserving) {
+  auto shares = weighted_fair_shares(/*capacity=*/8.0,
+                                     /*demands=*/{1.0, 2.0, 0.0},
+                                     /*weights=*/{1.0, 1.0, 1.0});
+  EXPECT_DOUBLE_EQ(shares[0], 6.0);
+  EXPECT_DOUBLE_EQ(shares[1], 7.0);
+  EXPECT_DOUBLE_EQ(shares[2], 5.0);
+}
+
+TEST(WeightedFairShares, empty) {
+  EXPECT_TRUE(weighted_fair_shares(8.0, {}, {}).empty());
+}
+
+}  // namespace theta
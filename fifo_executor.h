@@ -1,14 +1,16 @@
 #pragma once
 
 #include <memory>
-#include <mutex>
-#include <queue>
+#include <vector>
 
 #include "executor.h"
+#include "segmented_queue.h"
 #include "task.h"
 
 namespace theta {
 
+// Runs tasks in post order. Tasks wait in an unbounded lock-free queue, so
+// neither post() nor pop() takes a lock, however deep the backlog gets.
 class FIFOExecutorImpl : public ExecutorImpl {
   friend class ThrottlingThreadpool;
 
@@ -16,23 +18,18 @@ class FIFOExecutorImpl : public ExecutorImpl {
   ~FIFOExecutorImpl() override;
 
   void post(Func func) override;
+  void post_batch(std::vector<Func> funcs) override;
 
-  FIFOExecutorImpl(const Executor::Opts& opts)
-      : ExecutorImpl(opts),
-        fast_post_queue_(QueueOpts{}),
-        fast_pop_queue_(QueueOpts{}) {}
+  FIFOExecutorImpl(const Executor::Opts& opts) : ExecutorImpl(opts) {}
 
  protected:
   std::unique_ptr<Task> pop() override;
 
  private:
-  Queue<Task*> fast_post_queue_;
-  Queue<Task*> fast_pop_queue_;
+  SegmentedQueue<Task*> queue_;
 
-  std::mutex mu_;
-  std::queue<Task*> slow_queue_;
-
-  void shuffle_fifo_queues(Task* task_to_post, Task** task_to_pop);
+  // Queues func without admitting it.
+  void push(Func func);
 };
 
 }  // namespace theta
@@ -20,9 +20,9 @@ TEST(FIFOExecutor, DISABLED_ctor) {
           .set_thread_weight(5)
           .set_worker_limit(2));
 
-  EXPECT_EQ(executor.opts().priority_policy(), PriorityPolicy::FIFO);
-  EXPECT_EQ(executor.opts().thread_weight(), 5);
-  EXPECT_EQ(executor.opts().worker_limit(), 2);
+  EXPECT_EQ(executor.opts()->priority_policy(), PriorityPolicy::FIFO);
+  EXPECT_EQ(executor.opts()->thread_weight(), 5);
+  EXPECT_EQ(executor.opts()->worker_limit(), 2);
 }
 
 TEST(FIFOExecutor, DISABLED_post) {
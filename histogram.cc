@@ -0,0 +1,103 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace theta {
+
+void Histogram::record(uint64_t value, uint64_t count) {
+  buckets_[bucket_index(value)] += count;
+  count_ += count;
+  sum_ += value * count;
+  max_ = std::max(max_, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = std::max(max_, other.max_);
+}
+
+double Histogram::mean() const {
+  return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;
+}
+
+uint64_t Histogram::percentile(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  p = std::clamp(p, 0.0, 100.0);
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(p / 100.0 * count_)));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(bucket_upper_bound(i), max_);
+    }
+  }
+  return max_;
+}
+
+std::string Histogram::debug_string() const {
+  std::string s{"Histogram{"};
+  s += "count=" + std::to_string(count());
+  s += ", mean=" + std::to_string(mean());
+  s += ", p50=" + std::to_string(percentile(50.0));
+  s += ", p99=" + std::to_string(percentile(99.0));
+  s += ", p999=" + std::to_string(percentile(99.9));
+  s += ", max=" + std::to_string(max());
+  s += "}";
+  return s;
+}
+
+ConcurrentHistogram::~ConcurrentHistogram() {
+  for (auto& slot : shards_) {
+    delete slot.load(std::memory_order::acquire);
+  }
+}
+
+Histogram ConcurrentHistogram::snapshot() const {
+  Histogram h;
+  for (const auto& slot : shards_) {
+    const Shard* shard = slot.load(std::memory_order::acquire);
+    if (!shard) {
+      continue;
+    }
+    for (size_t i = 0; i < Histogram::kNumBuckets; i++) {
+      uint64_t n = shard->buckets[i].load(std::memory_order::relaxed);
+      h.buckets_[i] += n;
+      h.count_ += n;
+    }
+    h.sum_ += shard->sum.load(std::memory_order::relaxed);
+    h.max_ = std::max(h.max_, shard->max.load(std::memory_order::relaxed));
+  }
+  return h;
+}
+
+size_t ConcurrentHistogram::allocated_shards() const {
+  return std::count_if(shards_.begin(), shards_.end(), [](const auto& slot) {
+    return slot.load(std::memory_order::relaxed) != nullptr;
+  });
+}
+
+/*static*/
+ConcurrentHistogram::Shard* ConcurrentHistogram::allocate_shard(
+    std::atomic<Shard*>& slot) {
+  auto* shard = new Shard;
+  Shard* expected = nullptr;
+  if (!slot.compare_exchange_strong(expected, shard,
+                                    std::memory_order::acq_rel,
+                                    std::memory_order::acquire)) {
+    delete shard;
+    return expected;
+  }
+  return shard;
+}
+
+}  // namespace theta
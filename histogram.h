@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "epoch.h"
+#include "queue.h"
+
+namespace theta {
+
+// A log-linear histogram in the style of HdrHistogram. Every power of two is
+// split into kSubBuckets linear buckets, so a recorded value is known to
+// within 1/kSubBuckets of itself no matter how large it is. Values above
+// kMaxValue are counted in the last bucket.
+//
+// This is a plain value type. ConcurrentHistogram records into a few sharded
+// copies of the buckets and merges them into a Histogram on read.
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  static constexpr int kMaxValueBits = 32;
+  static constexpr uint64_t kMaxValue = (uint64_t{1} << kMaxValueBits) - 1;
+  static constexpr size_t kNumBuckets =
+      (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+  static constexpr size_t bucket_index(uint64_t value) {
+    if (value > kMaxValue) {
+      value = kMaxValue;
+    }
+    if (value < kSubBuckets) {
+      return value;
+    }
+    int msb = std::bit_width(value) - 1;
+    int shift = msb - kSubBucketBits;
+    return (msb - kSubBucketBits + 1) * kSubBuckets +
+           ((value >> shift) - kSubBuckets);
+  }
+
+  // The smallest and largest values that land in a bucket.
+  static constexpr uint64_t bucket_lower_bound(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    return (kSubBuckets + index % kSubBuckets) << shift;
+  }
+  static constexpr uint64_t bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    return bucket_lower_bound(index) + (uint64_t{1} << shift) - 1;
+  }
+
+  void record(uint64_t value, uint64_t count = 1);
+  void merge(const Histogram& other);
+
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t max() const { return max_; }
+  double mean() const;
+
+  // The smallest value that is at least as large as p percent of the
+  // recorded values, rounded up to the end of its bucket. Returns 0 if
+  // nothing was recorded.
+  uint64_t percentile(double p) const;
+
+  uint64_t bucket_count(size_t index) const { return buckets_[index]; }
+
+  std::string debug_string() const;
+
+ private:
+  friend class ConcurrentHistogram;
+
+  std::array<uint64_t, kNumBuckets> buckets_{};
+  uint64_t count_{0};
+  uint64_t sum_{0};
+  uint64_t max_{0};
+};
+
+// A Histogram that any number of threads can record into without taking a
+// lock. Each record is a relaxed fetch_add on one of kShards copies of the
+// buckets, picked by the recording CPU, so recorders on CPUs that share a
+// copy contend a little. A copy is only allocated by its first record, so a
+// histogram that is rarely recorded into stays small however many CPUs
+// there are.
+// snapshot() adds up the copies. It does not stop recorders, so a snapshot
+// taken under load may be missing the records that were in flight.
+class ConcurrentHistogram {
+ public:
+  static constexpr size_t kShards = 8;
+
+  ConcurrentHistogram() = default;
+  ~ConcurrentHistogram();
+
+  ConcurrentHistogram(const ConcurrentHistogram&) = delete;
+  ConcurrentHistogram& operator=(const ConcurrentHistogram&) = delete;
+
+  void record(uint64_t value) {
+    auto& slot = shards_[get_local_cpu() % kShards];
+    Shard* shard = slot.load(std::memory_order::acquire);
+    if (!shard) {
+      shard = allocate_shard(slot);
+    }
+    shard->buckets[Histogram::bucket_index(value)].fetch_add(
+        1, std::memory_order::relaxed);
+    shard->sum.fetch_add(value, std::memory_order::relaxed);
+
+    uint64_t max = shard->max.load(std::memory_order::relaxed);
+    while (value > max && !shard->max.compare_exchange_weak(
+                              max, value, std::memory_order::relaxed)) {
+    }
+  }
+
+  Histogram snapshot() const;
+
+  // The number of copies that have been allocated.
+  size_t allocated_shards() const;
+
+ private:
+  struct alignas(hardware_destructive_interference_size) Shard {
+    std::array<std::atomic<uint64_t>, Histogram::kNumBuckets> buckets{};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+  };
+
+  std::array<std::atomic<Shard*>, kShards> shards_{};
+
+  // Installs a new shard in slot, unless a racing recorder got there first.
+  static Shard* allocate_shard(std::atomic<Shard*>& slot);
+};
+
+}  // namespace theta
@@ -0,0 +1,110 @@
+#include "histogram.h"
+
+#include <glog/logging.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+TEST(Histogram, buckets_are_contiguous) {
+  for (size_t i = 1; i < Histogram::kNumBuckets; i++) {
+    EXPECT_EQ(Histogram::bucket_lower_bound(i),
+              Histogram::bucket_upper_bound(i - 1) + 1);
+  }
+  EXPECT_EQ(Histogram::bucket_upper_bound(Histogram::kNumBuckets - 1),
+            Histogram::kMaxValue);
+}
+
+TEST(Histogram, values_land_in_their_bucket) {
+  for (uint64_t v : {0UL, 1UL, 15UL, 16UL, 17UL, 31UL, 32UL, 1000UL,
+                     123456UL, Histogram::kMaxValue}) {
+    size_t i = Histogram::bucket_index(v);
+    EXPECT_LE(Histogram::bucket_lower_bound(i), v);
+    EXPECT_GE(Histogram::bucket_upper_bound(i), v);
+  }
+  EXPECT_EQ(Histogram::bucket_index(Histogram::kMaxValue + 1000),
+            Histogram::kNumBuckets - 1);
+}
+
+TEST(Histogram, relative_error_is_bounded) {
+  for (size_t i = Histogram::kSubBuckets; i < Histogram::kNumBuckets; i++) {
+    double lower = Histogram::bucket_lower_bound(i);
+    double upper = Histogram::bucket_upper_bound(i);
+    EXPECT_LT((upper - lower) / lower, 1.0 / Histogram::kSubBuckets);
+  }
+}
+
+TEST(Histogram, percentiles) {
+  Histogram h;
+  EXPECT_EQ(h.percentile(99.0), 0);
+
+  for (uint64_t v = 1; v <= 10000; v++) {
+    h.record(v);
+  }
+
+  EXPECT_EQ(h.count(), 10000);
+  EXPECT_EQ(h.max(), 10000);
+  EXPECT_DOUBLE_EQ(h.mean(), 5000.5);
+  for (double p : {50.0, 90.0, 99.0, 99.9}) {
+    double exact = p * 100.0;
+    double got = h.percentile(p);
+    EXPECT_GE(got, exact);
+    EXPECT_LE(got, exact * (1.0 + 1.0 / Histogram::kSubBuckets));
+  }
+  EXPECT_EQ(h.percentile(100.0), 10000);
+}
+
+TEST(Histogram, merge) {
+  Histogram a;
+  Histogram b;
+  a.record(10, /*count=*/3);
+  b.record(1000);
+
+  a.merge(b);
+  EXPECT_EQ(a.count(), 4);
+  EXPECT_EQ(a.sum(), 1030);
+  EXPECT_EQ(a.max(), 1000);
+  EXPECT_EQ(a.percentile(75.0), 10);
+  EXPECT_EQ(a.percentile(100.0), 1000);
+}
+
+TEST(ConcurrentHistogram, concurrent_records_are_merged) {
+  static constexpr int kThreads = 8;
+  static constexpr int kRecords = 100000;
+
+  ConcurrentHistogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&h, t]() {
+      for (int i = 0; i < kRecords; i++) {
+        h.record(t * 100 + i % 100);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto snapshot = h.snapshot();
+  EXPECT_EQ(snapshot.count(), kThreads * kRecords);
+  EXPECT_EQ(snapshot.max(), (kThreads - 1) * 100 + 99);
+  EXPECT_EQ(snapshot.bucket_count(Histogram::bucket_index(0)),
+            kRecords / 100);
+  EXPECT_LE(h.allocated_shards(), ConcurrentHistogram::kShards);
+}
+
+TEST(ConcurrentHistogram, shards_are_allocated_by_records) {
+  ConcurrentHistogram h;
+  EXPECT_EQ(h.allocated_shards(), 0);
+  EXPECT_EQ(h.snapshot().count(), 0);
+
+  h.record(5);
+  EXPECT_EQ(h.allocated_shards(), 1);
+  EXPECT_EQ(h.snapshot().count(), 1);
+  EXPECT_EQ(h.snapshot().max(), 5);
+}
+
+}  // namespace theta
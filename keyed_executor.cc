@@ -0,0 +1,166 @@
+#include "keyed_executor.h"
+
+#include <glog/logging.h>
+
+#include <thread>
+
+namespace theta {
+
+namespace {
+
+// std::hash is the identity for integers, so mix the bits before they pick
+// a lane. The second mix gives rebalancing an independent second choice.
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+uint64_t mix2(uint64_t x) { return mix(x ^ 0x9e3779b97f4a7c15ULL); }
+
+constexpr uint64_t kCountMask = 0xffffffffULL;
+
+}  // namespace
+
+KeyedExecutor::KeyedExecutor(Executor executor, Opts opts)
+    : state_(std::make_shared<State>(executor, opts)) {}
+
+void KeyedExecutor::post(uint64_t key, Func func) {
+  state_->post(key, std::move(func));
+}
+
+size_t KeyedExecutor::lane(uint64_t key) const { return state_->lane(key); }
+
+KeyedExecutor::State::State(Executor executor, const Opts& opts)
+    : executor_(executor),
+      max_batch_(opts.max_batch()),
+      lanes_(opts.num_lanes() ? opts.num_lanes()
+                              : 4 * std::thread::hardware_concurrency()) {
+  CHECK_GT(max_batch_, 0);
+  CHECK_LE(lanes_.size(), kCountMask);
+  if (opts.rebalance()) {
+    key_slots_ = std::make_unique<std::atomic<uint64_t>[]>(kKeySlots);
+  }
+}
+
+KeyedExecutor::State::~State() {
+  // Every drain holds a reference, so the lanes are idle.
+  for (auto& lane : lanes_) {
+    DCHECK_EQ(lane.word.load(std::memory_order::relaxed), 0);
+  }
+}
+
+size_t KeyedExecutor::State::lane(uint64_t key) const {
+  return mix(key) % lanes_.size();
+}
+
+size_t KeyedExecutor::State::assign(uint64_t hash, size_t* key_slot) {
+  if (!key_slots_) {
+    *key_slot = kKeySlots;
+    return mix(hash) % lanes_.size();
+  }
+
+  *key_slot = mix(hash) % kKeySlots;
+  auto& slot = key_slots_[*key_slot];
+  uint64_t packed = slot.load(std::memory_order::acquire);
+  while (true) {
+    uint64_t lane_index;
+    if ((packed & kCountMask) == 0) {
+      // Nothing of these keys is queued or running, so they may move
+      // without reordering anything.
+      size_t a = mix(hash) % lanes_.size();
+      size_t b = mix2(hash) % lanes_.size();
+      lane_index = lanes_[b].pending.load(std::memory_order::relaxed) <
+                           lanes_[a].pending.load(std::memory_order::relaxed)
+                       ? b
+                       : a;
+    } else {
+      lane_index = packed >> 32;
+    }
+    uint64_t next = (lane_index << 32) | ((packed & kCountMask) + 1);
+    if (slot.compare_exchange_weak(packed, next, std::memory_order::acq_rel,
+                                   std::memory_order::acquire)) {
+      lanes_[lane_index].pending.fetch_add(1, std::memory_order::relaxed);
+      return lane_index;
+    }
+  }
+}
+
+void KeyedExecutor::State::post(uint64_t key, Func func) {
+  size_t key_slot;
+  size_t lane_index = assign(key, &key_slot);
+  auto* node =
+      new Node{.next = nullptr, .func = std::move(func), .key_slot = key_slot};
+
+  Lane& lane = lanes_[lane_index];
+  uintptr_t word = lane.word.load(std::memory_order::relaxed);
+  do {
+    node->next = reinterpret_cast<Node*>(word & ~kScheduled);
+  } while (!lane.word.compare_exchange_weak(
+      word, reinterpret_cast<uintptr_t>(node) | kScheduled,
+      std::memory_order::release, std::memory_order::relaxed));
+
+  if (!(word & kScheduled)) {
+    schedule(lane_index, nullptr);
+  }
+}
+
+KeyedExecutor::Node* KeyedExecutor::State::take(Lane& lane) {
+  uintptr_t word = lane.word.load(std::memory_order::acquire);
+  while (true) {
+    DCHECK(word & kScheduled);
+    uintptr_t next = word == kScheduled ? 0 : kScheduled;
+    if (lane.word.compare_exchange_weak(word, next,
+                                        std::memory_order::acq_rel,
+                                        std::memory_order::acquire)) {
+      break;
+    }
+  }
+
+  // The stack is newest first.
+  Node* reversed = nullptr;
+  Node* node = reinterpret_cast<Node*>(word & ~kScheduled);
+  while (node) {
+    Node* next = node->next;
+    node->next = reversed;
+    reversed = node;
+    node = next;
+  }
+  return reversed;
+}
+
+void KeyedExecutor::State::drain(size_t lane_index, Node* batch) {
+  Lane& lane = lanes_[lane_index];
+  for (size_t ran = 0; ran < max_batch_; ran++) {
+    if (!batch) {
+      batch = take(lane);
+      if (!batch) {
+        return;
+      }
+    }
+
+    Node* node = batch;
+    batch = batch->next;
+    node->func();
+    if (node->key_slot != kKeySlots) {
+      lane.pending.fetch_sub(1, std::memory_order::relaxed);
+      key_slots_[node->key_slot].fetch_sub(1, std::memory_order::acq_rel);
+    }
+    delete node;
+  }
+
+  // The rest of the batch goes with the re-posted drain, since it must run
+  // before anything that is still on the lane.
+  schedule(lane_index, batch);
+}
+
+void KeyedExecutor::State::schedule(size_t lane_index, Node* batch) {
+  executor_.post([self = shared_from_this(), lane_index, batch]() {
+    self->drain(lane_index, batch);
+  });
+}
+
+}  // namespace theta
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "executor.h"
+
+namespace theta {
+
+class KeyedExecutorOpts {
+ public:
+  // The number of serial lanes that keys hash onto. Defaults to four per
+  // CPU, so that unrelated keys rarely share a lane.
+  size_t num_lanes() const { return num_lanes_; }
+  KeyedExecutorOpts& set_num_lanes(size_t val) {
+    num_lanes_ = val;
+    return *this;
+  }
+
+  // The most funcs that a lane runs per handoff to a worker.
+  size_t max_batch() const { return max_batch_; }
+  KeyedExecutorOpts& set_max_batch(size_t val) {
+    max_batch_ = val;
+    return *this;
+  }
+
+  // Lets a key move to the less loaded of two lanes whenever it has nothing
+  // queued or running, so that two hot keys that hash onto the same lane do
+  // not stay stuck behind each other. This costs a table of kKeySlots words
+  // and two atomic updates per post.
+  bool rebalance() const { return rebalance_; }
+  KeyedExecutorOpts& set_rebalance(bool val) {
+    rebalance_ = val;
+    return *this;
+  }
+
+ private:
+  size_t num_lanes_{0};
+  size_t max_batch_{32};
+  bool rebalance_{false};
+};
+
+// Runs the funcs that are posted with the same key one at a time and in post
+// order, and funcs with different keys in parallel, on top of an executor.
+// Keys hash onto a fixed set of serial lanes, so there is no per-key object
+// to create or clean up.
+//
+// A lane is a single word: the head of an intrusive stack of posted funcs,
+// plus a bit that is set while a drain is posted or running. An idle lane
+// holds nothing. The post that sets the bit posts a drain to the executor,
+// which takes the whole stack with one CAS, reverses it into post order and
+// runs up to max_batch funcs before it re-posts itself.
+//
+// Funcs that are still queued when the KeyedExecutor is destroyed still run.
+class KeyedExecutor {
+ public:
+  using Func = Executor::Func;
+  using Opts = KeyedExecutorOpts;
+
+  static constexpr size_t kKeySlots = 1 << 16;
+
+  explicit KeyedExecutor(Executor executor, Opts opts = Opts{});
+
+  void post(uint64_t key, Func func);
+
+  template <typename Key>
+  void post(const Key& key, Func func) {
+    post(static_cast<uint64_t>(std::hash<Key>{}(key)), std::move(func));
+  }
+
+  // The lane that key hashes onto when rebalancing is off.
+  size_t lane(uint64_t key) const;
+
+ private:
+  struct Node {
+    Node* next;
+    Func func;
+    // The key slot to release after func runs, or kKeySlots.
+    size_t key_slot;
+  };
+
+  class State : public std::enable_shared_from_this<State> {
+   public:
+    State(Executor executor, const Opts& opts);
+    ~State();
+
+    void post(uint64_t key, Func func);
+    size_t lane(uint64_t key) const;
+
+   private:
+    static constexpr uintptr_t kScheduled = 1;
+
+    struct Lane {
+      // Node* of the newest func, or'd with kScheduled.
+      std::atomic<uintptr_t> word{0};
+      // Funcs posted to the lane that have not finished. Only kept up to
+      // date when rebalancing.
+      std::atomic<int64_t> pending{0};
+    };
+
+    Executor executor_;
+    const size_t max_batch_;
+    std::vector<Lane> lanes_;
+
+    // Indexed by key hash. Each slot packs the lane that its keys are on in
+    // the high half and their number of unfinished funcs in the low half.
+    // Keys that share a slot move together.
+    std::unique_ptr<std::atomic<uint64_t>[]> key_slots_;
+
+    // Picks a lane for a func and counts the func into its key slot.
+    size_t assign(uint64_t hash, size_t* key_slot);
+
+    // Takes the lane's posted funcs in post order, or clears kScheduled and
+    // returns nullptr if there are none.
+    Node* take(Lane& lane);
+    void drain(size_t lane_index, Node* batch);
+    void schedule(size_t lane_index, Node* batch);
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace theta
@@ -0,0 +1,125 @@
+#include "keyed_executor.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <latch>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+namespace {
+
+Executor create_executor() {
+  auto num_threads = std::thread::hardware_concurrency();
+  return ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(num_threads)
+          .set_worker_limit(Executor::Opts::kNoWorkerLimit));
+}
+
+// Posts kPerKey funcs for each of kKeys keys from several threads, and
+// checks that each key's funcs ran one at a time and in post order.
+void expect_per_key_order(KeyedExecutor& keyed) {
+  static constexpr int kKeys = 1000;
+  static constexpr int kPerKey = 50;
+  static constexpr int kPosters = 4;
+
+  struct KeyState {
+    int next{0};
+    std::atomic<int> in_flight{0};
+  };
+  std::vector<KeyState> keys(kKeys);
+  std::atomic<bool> ordered{true};
+  std::latch done{kKeys * kPerKey};
+
+  // Each poster owns a subset of the keys, so that each key's post order is
+  // well defined.
+  std::vector<std::thread> posters;
+  for (int p = 0; p < kPosters; p++) {
+    posters.emplace_back([&, p]() {
+      for (int i = 0; i < kPerKey; i++) {
+        for (int k = p; k < kKeys; k += kPosters) {
+          keyed.post(static_cast<uint64_t>(k), [&, k, i]() {
+            if (keys[k].in_flight.fetch_add(1) != 0 || keys[k].next != i) {
+              ordered.store(false);
+            }
+            keys[k].next = i + 1;
+            keys[k].in_flight.fetch_sub(1);
+            done.count_down();
+          });
+        }
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+  done.wait();
+
+  EXPECT_TRUE(ordered.load());
+}
+
+}  // namespace
+
+TEST(KeyedExecutor, runs_each_key_in_order) {
+  KeyedExecutor keyed{
+      create_executor(),
+      KeyedExecutor::Opts{}.set_num_lanes(64).set_max_batch(4)};
+  expect_per_key_order(keyed);
+}
+
+TEST(KeyedExecutor, runs_each_key_in_order_with_rebalancing) {
+  KeyedExecutor keyed{
+      create_executor(),
+      KeyedExecutor::Opts{}.set_num_lanes(8).set_rebalance(true)};
+  expect_per_key_order(keyed);
+}
+
+TEST(KeyedExecutor, different_lanes_run_in_parallel) {
+  KeyedExecutor keyed{create_executor(),
+                      KeyedExecutor::Opts{}.set_num_lanes(64)};
+
+  uint64_t other = 1;
+  while (keyed.lane(other) == keyed.lane(0)) {
+    other++;
+  }
+
+  // Key 0 blocks until the other key has run, which would deadlock if they
+  // were serialized.
+  std::latch other_ran{1};
+  std::latch done{2};
+  keyed.post(uint64_t{0}, [&]() {
+    other_ran.wait();
+    done.count_down();
+  });
+  keyed.post(other, [&]() {
+    other_ran.count_down();
+    done.count_down();
+  });
+  done.wait();
+}
+
+TEST(KeyedExecutor, hashes_any_key_type) {
+  KeyedExecutor keyed{create_executor()};
+
+  std::vector<int> order;
+  std::latch done{3};
+  for (int i = 0; i < 3; i++) {
+    keyed.post(std::string{"account"}, [&, i]() {
+      order.push_back(i);
+      done.count_down();
+    });
+  }
+  done.wait();
+
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2}));
+}
+
+}  // namespace theta
@@ -0,0 +1,78 @@
+#include "lifo_executor.h"
+
+#include <glog/logging.h>
+
+#include "probes.h"
+
+namespace theta {
+
+LIFOExecutorImpl::~LIFOExecutorImpl() {
+  Task* task = head_.exchange(nullptr, std::memory_order::acquire);
+  while (task) {
+    std::unique_ptr<Task> owned{task};
+    task = task->pending_next_;
+  }
+}
+
+void LIFOExecutorImpl::post(Executor::Func func) {
+  Task* task = new_task(std::move(func));
+  push(task, task);
+  refill_queues();
+}
+
+void LIFOExecutorImpl::post_batch(std::vector<Func> funcs) {
+  if (funcs.empty()) {
+    return;
+  }
+
+  // The last func ends up on top, as if the funcs were posted in turn.
+  Task* bottom = nullptr;
+  Task* top = nullptr;
+  for (auto& func : funcs) {
+    Task* task = new_task(std::move(func));
+    task->pending_next_ = top;
+    top = task;
+    if (!bottom) {
+      bottom = task;
+    }
+  }
+  push(top, bottom);
+  refill_queues();
+}
+
+Task* LIFOExecutorImpl::new_task(Executor::Func func) {
+  auto* task = new Task{Task::Opts{}.set_func(func).set_executor(this)};
+
+  task->set_state(Task::State::kQueuedExecutor);
+  THETA_PROBE2(post, this, task);
+  return task;
+}
+
+void LIFOExecutorImpl::push(Task* top, Task* bottom) {
+  Task* head = head_.load(std::memory_order::relaxed);
+  do {
+    bottom->pending_next_ = head;
+  } while (!head_.compare_exchange_weak(head, top,
+                                        std::memory_order::release,
+                                        std::memory_order::relaxed));
+}
+
+std::unique_ptr<Task> LIFOExecutorImpl::pop() {
+  // Skip the lock when there is obviously nothing to pop.
+  if (!head_.load(std::memory_order::acquire)) {
+    return nullptr;
+  }
+
+  std::lock_guard l{pop_mu_};
+  Task* head = head_.load(std::memory_order::acquire);
+  while (head && !head_.compare_exchange_weak(head, head->pending_next_,
+                                              std::memory_order::acquire,
+                                              std::memory_order::acquire)) {
+  }
+  if (head) {
+    head->pending_next_ = nullptr;
+  }
+  return std::unique_ptr<Task>{head};
+}
+
+}  // namespace theta
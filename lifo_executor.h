@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "executor.h"
+#include "task.h"
+
+namespace theta {
+
+// Runs the most recently posted task first. A task that posts follow-up work
+// tends to have its output still in cache when the follow-up runs.
+//
+// Posted tasks form a Treiber stack that is linked through the tasks
+// themselves, so post() is a single CAS, and so is post_batch(), which links
+// its tasks before it pushes them. Pops are serialized by a mutex.
+// With a single popper at a time, no node can be popped and pushed again
+// between a popper's load and its CAS, so the stack is free of ABA without
+// tagged pointers or hazard pointers.
+class LIFOExecutorImpl : public ExecutorImpl {
+  friend class ThrottlingThreadpool;
+
+ public:
+  ~LIFOExecutorImpl() override;
+
+  void post(Func func) override;
+  void post_batch(std::vector<Func> funcs) override;
+
+  LIFOExecutorImpl(const Executor::Opts& opts) : ExecutorImpl(opts) {}
+
+ protected:
+  std::unique_ptr<Task> pop() override;
+
+ private:
+  std::atomic<Task*> head_{nullptr};
+  std::mutex pop_mu_;
+
+  Task* new_task(Func func);
+  // Pushes the chain of tasks from top to bottom, linked through
+  // pending_next_, with a single CAS.
+  void push(Task* top, Task* bottom);
+};
+
+}  // namespace theta
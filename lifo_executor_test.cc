@@ -0,0 +1,103 @@
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+TEST(LIFOExecutor, ctor) {
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(5)
+          .set_worker_limit(2));
+
+  EXPECT_EQ(executor.opts()->priority_policy(), PriorityPolicy::LIFO);
+  EXPECT_EQ(executor.opts()->thread_weight(), 5);
+  EXPECT_EQ(executor.opts()->worker_limit(), 2);
+}
+
+TEST(LIFOExecutor, runs_newest_first) {
+  static constexpr int kJobs = 10;
+
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(1)
+          .set_worker_limit(1));
+
+  // Holds the only active slot while the other jobs are posted.
+  std::latch blocker_started{1};
+  std::latch release_blocker{1};
+  executor.post([&]() {
+    blocker_started.count_down();
+    release_blocker.wait();
+  });
+  blocker_started.wait();
+
+  std::mutex mu;
+  std::vector<int> order;
+  std::latch done{kJobs};
+  for (int i = 0; i < kJobs; i++) {
+    executor.post([&, i]() {
+      {
+        std::lock_guard l{mu};
+        order.push_back(i);
+      }
+      done.count_down();
+    });
+  }
+  release_blocker.count_down();
+  done.wait();
+
+  ASSERT_EQ(order.size(), kJobs);
+  for (int i = 0; i < kJobs; i++) {
+    EXPECT_EQ(order[i], kJobs - 1 - i);
+  }
+}
+
+TEST(LIFOExecutor, saturate_many_threads) {
+  static constexpr int kJobs = 1000000;
+
+  auto num_threads = std::thread::hardware_concurrency();
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(num_threads)
+          .set_worker_limit(Executor::Opts::kNoWorkerLimit));
+
+  std::latch work_done{kJobs};
+  std::atomic<int> jobsRun{0};
+
+  auto job = std::function<void()>([&]() {
+    jobsRun.fetch_add(1, std::memory_order_acq_rel);
+    work_done.count_down(1);
+  });
+
+  std::vector<std::thread> posters;
+  for (unsigned t = 0; t < num_threads; t++) {
+    posters.emplace_back([&, t]() {
+      for (int i = t; i < kJobs; i += num_threads) {
+        executor.post(job);
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+
+  while (!work_done.try_wait()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_EQ(jobsRun.load(std::memory_order_acquire), kJobs);
+}
+
+}  // namespace theta
@@ -0,0 +1,72 @@
+#include "numa.h"
+
+#include <glog/logging.h>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <climits>
+
+namespace theta {
+
+namespace {
+
+constexpr int kMaxNodes = 1024;
+constexpr int kBitsPerLong = sizeof(long) * CHAR_BIT;
+
+using NodeMask = std::array<unsigned long, kMaxNodes / kBitsPerLong>;
+
+bool node_mask(int node, NodeMask* mask) {
+  if (node < 0 || node >= kMaxNodes) {
+    return false;
+  }
+  mask->fill(0);
+  (*mask)[node / kBitsPerLong] |= 1UL << (node % kBitsPerLong);
+  return true;
+}
+
+size_t round_to_pages(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+}  // namespace
+
+bool bind_to_node(void* addr, size_t len, int node) {
+  NodeMask mask;
+  if (!node_mask(node, &mask)) {
+    return false;
+  }
+  // The kernel ignores the last bit of maxnode, as libnuma knows.
+  return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask.data(),
+                 kMaxNodes + 1, 0) == 0;
+}
+
+bool prefer_node_for_thread(int node) {
+  NodeMask mask;
+  if (!node_mask(node, &mask)) {
+    return false;
+  }
+  return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(),
+                 kMaxNodes + 1) == 0;
+}
+
+void* allocate_on_node(size_t size, int node) {
+  size = round_to_pages(size);
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    throw std::bad_alloc{};
+  }
+  // Nothing is touched yet, so the binding decides where every page goes.
+  bind_to_node(ptr, size, node);
+  return ptr;
+}
+
+void free_on_node(void* ptr, size_t size) {
+  PCHECK(munmap(ptr, round_to_pages(size)) == 0);
+}
+
+}  // namespace theta
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace theta {
+
+// Asks the kernel to back [addr, addr + len) with memory from node when it is
+// first touched. addr must be page aligned. Returns false if the kernel has no
+// NUMA support or refuses, in which case the memory is placed as usual.
+bool bind_to_node(void* addr, size_t len, int node);
+
+// Makes the calling thread's later allocations prefer memory from node.
+bool prefer_node_for_thread(int node);
+
+// Whole pages, bound to node when possible. Only for long-lived objects.
+void* allocate_on_node(size_t size, int node);
+void free_on_node(void* ptr, size_t size);
+
+template <typename T>
+struct NodeLocalDeleter {
+  void operator()(T* t) const {
+    t->~T();
+    free_on_node(t, sizeof(T));
+  }
+};
+
+template <typename T>
+using NodeLocalPtr = std::unique_ptr<T, NodeLocalDeleter<T>>;
+
+template <typename T, typename... Args>
+NodeLocalPtr<T> make_node_local(int node, Args&&... args) {
+  void* mem = allocate_on_node(sizeof(T), node);
+  return NodeLocalPtr<T>{new (mem) T(std::forward<Args>(args)...)};
+}
+
+}  // namespace theta
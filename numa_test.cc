@@ -0,0 +1,55 @@
+#include "numa.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "topology.h"
+
+namespace theta {
+
+namespace {
+
+struct Counted {
+  explicit Counted(int* live) : live_(live) { (*live_)++; }
+  ~Counted() { (*live_)--; }
+
+  int* live_;
+  char payload[10000];
+};
+
+}  // namespace
+
+TEST(Numa, allocation_on_each_node_is_usable) {
+  for (const auto& node : CpuTopology::get().nodes()) {
+    void* ptr = allocate_on_node(100000, node.id);
+    ASSERT_NE(ptr, nullptr);
+    memset(ptr, 0xab, 100000);
+    free_on_node(ptr, 100000);
+  }
+}
+
+TEST(Numa, unknown_node_falls_back) {
+  EXPECT_FALSE(bind_to_node(nullptr, 0, -1));
+  EXPECT_FALSE(prefer_node_for_thread(1 << 20));
+
+  // The binding is only a hint, so the memory is still there.
+  void* ptr = allocate_on_node(1, 1 << 20);
+  ASSERT_NE(ptr, nullptr);
+  *static_cast<char*>(ptr) = 1;
+  free_on_node(ptr, 1);
+}
+
+TEST(Numa, node_local_object_is_constructed_and_destroyed) {
+  int live = 0;
+  {
+    auto counted = make_node_local<Counted>(get_local_node(), &live);
+    EXPECT_EQ(live, 1);
+    memset(counted->payload, 1, sizeof(counted->payload));
+  }
+  EXPECT_EQ(live, 0);
+}
+
+}  // namespace theta
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#include "epoch.h"
+#include "queue.h"
+
+namespace theta {
+
+// One T per CPU, each on its own cache line, so that threads on different
+// CPUs can update their own copy without contending. Writers use local(), and
+// readers visit every copy with for_each() and combine them.
+//
+// get_local_cpu() is cached for a few calls, so a thread that migrates may
+// keep using its old CPU's copy for a little while. T must therefore still be
+// safe to update from several threads, e.g. by using relaxed atomics.
+template <typename T>
+class PerCpu {
+ public:
+  PerCpu()
+      : size_(std::max(1U, std::thread::hardware_concurrency())),
+        slots_(new Slot[size_]) {}
+
+  PerCpu(const PerCpu&) = delete;
+  PerCpu& operator=(const PerCpu&) = delete;
+
+  T& local() { return slots_[get_local_cpu() % size_].value; }
+
+  size_t size() const { return size_; }
+
+  template <typename Func>
+  void for_each(Func&& func) const {
+    for (size_t i = 0; i < size_; i++) {
+      func(slots_[i].value);
+    }
+  }
+
+ private:
+  struct alignas(hardware_destructive_interference_size) Slot {
+    T value{};
+  };
+
+  const size_t size_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+}  // namespace theta
@@ -0,0 +1,47 @@
+#include "priority_executor.h"
+
+#include <glog/logging.h>
+
+#include "probes.h"
+
+namespace theta {
+
+PriorityExecutorImpl::~PriorityExecutorImpl() {
+  while (auto task = queue_.try_pop()) {
+    delete task.value();
+  }
+}
+
+void PriorityExecutorImpl::post(Executor::Func func) {
+  post(std::move(func), kDefaultPriority);
+}
+
+void PriorityExecutorImpl::post(Executor::Func func, int priority) {
+  push(std::move(func), priority);
+  refill_queues();
+}
+
+void PriorityExecutorImpl::post_batch(std::vector<Func> funcs) {
+  for (auto& func : funcs) {
+    push(std::move(func), kDefaultPriority);
+  }
+  refill_queues();
+}
+
+void PriorityExecutorImpl::push(Executor::Func func, int priority) {
+  auto* task = new Task{Task::Opts{}.set_func(func).set_executor(this)};
+
+  task->set_state(Task::State::kQueuedExecutor);
+  THETA_PROBE2(post, this, task);
+  queue_.push(task, priority);
+}
+
+std::unique_ptr<Task> PriorityExecutorImpl::pop() {
+  auto task = queue_.try_pop();
+  if (!task.has_value()) {
+    return nullptr;
+  }
+  return std::unique_ptr<Task>{task.value()};
+}
+
+}  // namespace theta
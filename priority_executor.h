@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "bucketed_priority_queue.h"
+#include "executor.h"
+#include "task.h"
+
+namespace theta {
+
+// Runs the task with the highest priority first, and tasks of equal priority
+// in roughly the order that they were posted. Priorities are clamped to
+// [kMinPriority, kMaxPriority]. Tasks posted without a priority get
+// kDefaultPriority, so callers can rank work both above and below them.
+class PriorityExecutorImpl : public ExecutorImpl {
+  friend class ThrottlingThreadpool;
+
+  using TaskQueue = BucketedPriorityQueue<Task*>;
+
+ public:
+  static constexpr int kMinPriority = TaskQueue::kMinPriority;
+  static constexpr int kMaxPriority = TaskQueue::kMaxPriority;
+  static constexpr int kDefaultPriority = (kMaxPriority + 1) / 2;
+
+  ~PriorityExecutorImpl() override;
+
+  void post(Func func) override;
+  void post(Func func, int priority) override;
+  void post_batch(std::vector<Func> funcs) override;
+
+  PriorityExecutorImpl(const Executor::Opts& opts) : ExecutorImpl(opts) {}
+
+ protected:
+  std::unique_ptr<Task> pop() override;
+
+ private:
+  TaskQueue queue_;
+
+  // Queues func without admitting it.
+  void push(Func func, int priority);
+};
+
+}  // namespace theta
@@ -0,0 +1,92 @@
+#include <glog/logging.h>
+
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+namespace {
+
+Executor create_single_slot_executor() {
+  return ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::ExplicitPriority)
+          .set_thread_weight(1)
+          .set_worker_limit(1));
+}
+
+}  // namespace
+
+TEST(PriorityExecutor, runs_highest_priority_first) {
+  Executor executor = create_single_slot_executor();
+
+  // Holds the only active slot while the other jobs are posted.
+  std::latch blocker_started{1};
+  std::latch release_blocker{1};
+  executor.post([&]() {
+    blocker_started.count_down();
+    release_blocker.wait();
+  });
+  blocker_started.wait();
+
+  std::mutex mu;
+  std::vector<int> order;
+  std::latch done{7};
+  auto record = [&](int i) {
+    return [&, i]() {
+      {
+        std::lock_guard l{mu};
+        order.push_back(i);
+      }
+      done.count_down();
+    };
+  };
+
+  // Out of range priorities clamp, and equal priorities run in post order.
+  executor.post(record(6), -100);
+  executor.post(record(3));
+  executor.post(record(4), PriorityExecutorImpl::kDefaultPriority - 1);
+  executor.post(record(0), 1000);
+  executor.post(record(1), PriorityExecutorImpl::kMaxPriority);
+  executor.post(record(2), PriorityExecutorImpl::kDefaultPriority + 1);
+  executor.post(record(5), PriorityExecutorImpl::kMinPriority);
+  release_blocker.count_down();
+  done.wait();
+
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4, 5, 6}));
+}
+
+TEST(PriorityExecutor, saturate_many_threads) {
+  static constexpr int kJobs = 100000;
+
+  auto num_threads = std::thread::hardware_concurrency();
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::ExplicitPriority)
+          .set_thread_weight(num_threads)
+          .set_worker_limit(Executor::Opts::kNoWorkerLimit));
+
+  std::latch work_done{kJobs};
+  auto job = [&]() { work_done.count_down(); };
+
+  std::vector<std::thread> posters;
+  for (unsigned t = 0; t < num_threads; t++) {
+    posters.emplace_back([&, t]() {
+      for (int i = t; i < kJobs; i += num_threads) {
+        executor.post(job, i % 64);
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+
+  work_done.wait();
+}
+
+}  // namespace theta
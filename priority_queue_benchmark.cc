@@ -0,0 +1,81 @@
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "bucketed_priority_queue.h"
+
+namespace theta {
+
+// The baseline: a binary heap behind a mutex.
+class LockedPriorityQueue {
+ public:
+  void push(int* val, int priority) {
+    std::lock_guard l{mu_};
+    heap_.push(Entry{priority, seq_++, val});
+  }
+
+  std::optional<int*> try_pop() {
+    std::lock_guard l{mu_};
+    if (heap_.empty()) {
+      return {};
+    }
+    int* val = heap_.top().val;
+    heap_.pop();
+    return val;
+  }
+
+ private:
+  struct Entry {
+    int priority;
+    uint64_t seq;
+    int* val;
+
+    bool operator<(const Entry& other) const {
+      return priority != other.priority ? priority < other.priority
+                                        : seq > other.seq;
+    }
+  };
+
+  std::mutex mu_;
+  std::priority_queue<Entry> heap_;
+  uint64_t seq_{0};
+};
+
+// Every thread pushes a batch of values at assorted priorities and then pops
+// as many values as it pushed, so the queue stays small and every thread
+// both produces and consumes. The queue is empty again after every run.
+template <typename QType>
+static void BM_push_pop(benchmark::State& state) {
+  static constexpr int kBatchSize = 16;
+  static QType queue;
+
+  int val;
+  int priority = state.thread_index();
+  for (auto _ : state) {
+    for (int i = 0; i < kBatchSize; i++) {
+      priority = (priority * 37 + 11) % 64;
+      queue.push(&val, priority);
+    }
+    for (int i = 0; i < kBatchSize; i++) {
+      while (!queue.try_pop().has_value()) {
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+BENCHMARK_TEMPLATE(BM_push_pop, BucketedPriorityQueue<int*>)
+    ->Threads(1)
+    ->Threads(4)
+    ->Threads(16);
+BENCHMARK_TEMPLATE(BM_push_pop, LockedPriorityQueue)
+    ->Threads(1)
+    ->Threads(4)
+    ->Threads(16);
+
+}  // namespace theta
+
+BENCHMARK_MAIN();
@@ -0,0 +1,51 @@
+#pragma once
+
+// USDT probes for bpftrace, perf and SystemTap, all under the "theta"
+// provider, e.g.
+//
+//   bpftrace -e 'usdt:./binary:theta:task_finish { @[arg0] = hist(arg2); }'
+//
+// A probe compiles to a single nop plus an ELF note that tells the tracer
+// where the nop is, so it costs nothing until a tracer attaches. The
+// arguments must already be in registers or memory, so only pass values
+// that the surrounding code has computed anyway.
+//
+// The probes compile away when <sys/sdt.h> (from systemtap-sdt-dev) is not
+// installed or THETA_DISABLE_PROBES is defined.
+//
+// Probes:
+//   post(executor, task)           the task was posted to its executor
+//   admit(executor, task)          the task took one of the active slots
+//   dequeue(executor, task)        a worker took the task off the run queue
+//   task_start(executor, task)
+//   task_finish(executor, task, wall_usec)
+//   throttle(executor, task)       the task moved to throttled priority
+//   unthrottle(executor, task)     the task moved back to normal priority
+//   limits(executor, active_limit, running_limit)
+//   sem_park(semaphore)            a thread is about to block
+//   sem_unpark(semaphore)          the thread woke up
+
+#if !defined(THETA_DISABLE_PROBES) && __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+
+#define THETA_PROBES_ENABLED 1
+#define THETA_PROBE1(name, a1) DTRACE_PROBE1(theta, name, a1)
+#define THETA_PROBE2(name, a1, a2) DTRACE_PROBE2(theta, name, a1, a2)
+#define THETA_PROBE3(name, a1, a2, a3) \
+  DTRACE_PROBE3(theta, name, a1, a2, a3)
+
+#else
+
+#define THETA_PROBES_ENABLED 0
+#define THETA_PROBE1(name, a1) \
+  do {                         \
+  } while (0)
+#define THETA_PROBE2(name, a1, a2) \
+  do {                             \
+  } while (0)
+#define THETA_PROBE3(name, a1, a2, a3) \
+  do {                                 \
+  } while (0)
+
+#endif
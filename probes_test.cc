@@ -0,0 +1,84 @@
+#include "probes.h"
+
+#include <elf.h>
+#include <glog/logging.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+namespace {
+
+// Returns the names of the "theta" probes in the .note.stapsdt section of
+// the running binary.
+std::set<std::string> theta_probes() {
+  std::ifstream in{"/proc/self/exe", std::ios::binary};
+  std::vector<char> elf{std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>()};
+  CHECK_GE(elf.size(), sizeof(Elf64_Ehdr));
+
+  const auto* ehdr = reinterpret_cast<const Elf64_Ehdr*>(elf.data());
+  CHECK_EQ(ehdr->e_ident[EI_CLASS], ELFCLASS64);
+  const auto* shdrs =
+      reinterpret_cast<const Elf64_Shdr*>(elf.data() + ehdr->e_shoff);
+  const char* shstrtab = elf.data() + shdrs[ehdr->e_shstrndx].sh_offset;
+
+  std::set<std::string> probes;
+  for (size_t i = 0; i < ehdr->e_shnum; i++) {
+    const auto& shdr = shdrs[i];
+    if (shdr.sh_type != SHT_NOTE ||
+        strcmp(shstrtab + shdr.sh_name, ".note.stapsdt") != 0) {
+      continue;
+    }
+
+    size_t offset = shdr.sh_offset;
+    size_t end = shdr.sh_offset + shdr.sh_size;
+    while (offset + sizeof(Elf64_Nhdr) <= end) {
+      const auto* nhdr = reinterpret_cast<const Elf64_Nhdr*>(&elf[offset]);
+      const char* name = &elf[offset + sizeof(Elf64_Nhdr)];
+      const char* desc = name + ((nhdr->n_namesz + 3) & ~3);
+      offset = desc - elf.data() + ((nhdr->n_descsz + 3) & ~3);
+
+      if (strcmp(name, "stapsdt") != 0) {
+        continue;
+      }
+      // The descriptor is the probe address, the base address and the
+      // semaphore address, followed by the provider, name and arguments.
+      const char* provider = desc + 3 * sizeof(Elf64_Addr);
+      const char* probe = provider + strlen(provider) + 1;
+      if (strcmp(provider, "theta") == 0) {
+        probes.insert(probe);
+      }
+    }
+  }
+  return probes;
+}
+
+}  // namespace
+
+TEST(Probes, notes_are_in_the_binary) {
+  if (!THETA_PROBES_ENABLED) {
+    GTEST_SKIP() << "Built without <sys/sdt.h>";
+  }
+
+  // Make sure that the objects with the probes are linked in.
+  volatile auto get_instance = &ThrottlingThreadpool::getInstance;
+  (void)get_instance;
+
+  auto probes = theta_probes();
+  for (const char* probe :
+       {"post", "admit", "dequeue", "task_start", "task_finish", "throttle",
+        "unthrottle", "limits", "sem_park", "sem_unpark"}) {
+    EXPECT_TRUE(probes.count(probe)) << probe;
+  }
+}
+
+}  // namespace theta
@@ -0,0 +1,322 @@
+#include "run_queue.h"
+
+#include <glog/logging.h>
+
+#include "probes.h"
+
+namespace theta {
+
+namespace {
+
+// Tells the CPU that this is a spin loop, which frees the core for an SMT
+// sibling and avoids a memory order violation on exit.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+}  // namespace
+
+void RunQueue::push(Lane* lane, std::unique_ptr<Task> task) {
+  DCHECK(task);
+
+  {
+    std::lock_guard lock{mu_};
+    lane->tasks_.push_back(task.release());
+    if (!lane->listed_) {
+      lane->listed_ = true;
+      ring_.push_back(lane);
+    }
+  }
+
+  size_.fetch_add(1, std::memory_order::acq_rel);
+  wake();
+}
+
+void RunQueue::mark_ready(Lane* lane) {
+  DCHECK(lane->admit_);
+  if (lane->ready_.exchange(true, std::memory_order::acq_rel)) {
+    return;
+  }
+
+  {
+    std::lock_guard lock{mu_};
+    lane->ready_next_ = nullptr;
+    if (ready_tail_) {
+      ready_tail_->ready_next_ = lane;
+    } else {
+      ready_head_ = lane;
+    }
+    ready_tail_ = lane;
+  }
+
+  wake();
+}
+
+void RunQueue::request_steal() {
+  steal_requests_.fetch_add(1, std::memory_order::acq_rel);
+  sem_.release();
+}
+
+void RunQueue::wake() {
+  sem_.release();
+
+  // Pairs with the fence in wait_pop_until, so that either this sees a
+  // timed out worker leave or that worker sees the token.
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+  if (starved_callback_ &&
+      idle_workers_.load(std::memory_order::acquire) == 0) {
+    starved_callback_();
+  }
+}
+
+void RunQueue::set_idle_spin(std::chrono::microseconds max_spin,
+                             size_t max_spinners) {
+  int64_t max_spin_nsec =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(max_spin).count();
+  max_spinners_.store(max_spinners, std::memory_order::relaxed);
+  spin_budget_nsec_.store(max_spin_nsec, std::memory_order::relaxed);
+  max_spin_nsec_.store(max_spin_nsec, std::memory_order::release);
+}
+
+bool RunQueue::spin_acquire() {
+  int64_t max_spin_nsec = max_spin_nsec_.load(std::memory_order::acquire);
+  if (max_spin_nsec <= 0) {
+    return false;
+  }
+  size_t spinners = spinners_.load(std::memory_order::relaxed);
+  do {
+    if (spinners >= max_spinners_.load(std::memory_order::relaxed)) {
+      return false;
+    }
+  } while (!spinners_.compare_exchange_weak(spinners, spinners + 1,
+                                            std::memory_order::acq_rel,
+                                            std::memory_order::relaxed));
+
+  int64_t budget = spin_budget_nsec_.load(std::memory_order::relaxed);
+  auto end =
+      std::chrono::steady_clock::now() + std::chrono::nanoseconds{budget};
+  bool acquired = false;
+  for (uint32_t i = 1;; i++) {
+    // Only reading the count keeps the line shared until a push writes it.
+    if (sem_.count() > 0 && sem_.try_acquire()) {
+      acquired = true;
+      break;
+    }
+    cpu_relax();
+    if (i % 64 == 0 && std::chrono::steady_clock::now() >= end) {
+      break;
+    }
+  }
+  spinners_.fetch_sub(1, std::memory_order::acq_rel);
+
+  // Racing spinners may each apply their own outcome, which only makes the
+  // budget adapt a little less smoothly.
+  spin_budget_nsec_.store(
+      acquired ? std::min(max_spin_nsec, budget * 2)
+               : std::max(max_spin_nsec / kMinSpinDivisor, budget / 2),
+      std::memory_order::relaxed);
+  return acquired;
+}
+
+std::unique_ptr<Task> RunQueue::maybe_pop() {
+  if (!sem_.try_acquire()) {
+    return nullptr;
+  }
+  return std::unique_ptr<Task>{take_token()};
+}
+
+std::unique_ptr<Task> RunQueue::wait_pop() {
+  while (true) {
+    idle_workers_.fetch_add(1, std::memory_order::acq_rel);
+    if (!spin_acquire()) {
+      semaphoreAcquireKludge(sem_);
+    }
+    idle_workers_.fetch_sub(1, std::memory_order::acq_rel);
+    if (shutdown_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+
+    if (Task* task = take_token()) {
+      return std::unique_ptr<Task>{task};
+    }
+  }
+}
+
+std::unique_ptr<Task> RunQueue::wait_pop_until(
+    std::chrono::system_clock::time_point deadline) {
+  while (true) {
+    // A spinning worker counts as idle, so that a push counts on it instead
+    // of starting another worker.
+    idle_workers_.fetch_add(1, std::memory_order::acq_rel);
+    bool acquired = spin_acquire() || sem_.try_acquire_until(deadline);
+    idle_workers_.fetch_sub(1, std::memory_order::acq_rel);
+    if (!acquired) {
+      // A push that came as the wait timed out still counted this worker as
+      // idle and started no other. The worker must take that task instead
+      // of retiring.
+      std::atomic_thread_fence(std::memory_order::seq_cst);
+      acquired = sem_.try_acquire();
+    }
+    if (!acquired || shutdown_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+
+    if (Task* task = take_token()) {
+      return std::unique_ptr<Task>{task};
+    }
+  }
+}
+
+std::unique_ptr<Task> RunQueue::steal() {
+  if (!sem_.try_acquire()) {
+    return nullptr;
+  }
+
+  Task* task;
+  {
+    std::lock_guard lock{mu_};
+    task = pop(lock);
+  }
+  if (!task) {
+    sem_.release(1);
+    return nullptr;
+  }
+  size_.fetch_sub(1, std::memory_order::acq_rel);
+  return std::unique_ptr<Task>{task};
+}
+
+Task* RunQueue::take_token() {
+  Task* task = nullptr;
+  Lane* ready;
+  {
+    std::lock_guard lock{mu_};
+    // Admitting first lets the new tasks compete in this round.
+    ready = pop_ready(lock);
+    if (!ready) {
+      task = pop(lock);
+    }
+  }
+
+  if (ready) {
+    // Each admitted task brings its own token.
+    ready->admit_();
+    return nullptr;
+  }
+  if (task) {
+    size_.fetch_sub(1, std::memory_order::acq_rel);
+    return task;
+  }
+  if (take_steal_request()) {
+    // The request brought the token, so it is spent even if the other
+    // queues were drained in the meantime.
+    return steal_callback_ ? steal_callback_().release() : nullptr;
+  }
+  sem_.release(1);
+  return nullptr;
+}
+
+bool RunQueue::take_steal_request() {
+  size_t requests = steal_requests_.load(std::memory_order::acquire);
+  while (requests > 0) {
+    if (steal_requests_.compare_exchange_weak(requests, requests - 1,
+                                              std::memory_order::acq_rel,
+                                              std::memory_order::acquire)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*static*/
+void RunQueue::charge(Lane* lane, Task* task, int64_t wall_usec) {
+  lane->correction_usec_.fetch_add(wall_usec - task->dispatch_estimate_usec_,
+                                   std::memory_order::relaxed);
+
+  // The estimate is an EMA with alpha = 1/8. Lost updates from racing
+  // workers only make it a little less smooth.
+  int64_t estimate = lane->estimate_usec_.load(std::memory_order::relaxed);
+  lane->estimate_usec_.store(estimate + (wall_usec - estimate) / 8,
+                             std::memory_order::relaxed);
+}
+
+Task* RunQueue::pop(const std::lock_guard<std::mutex>& lock) {
+  // Lanes refilled since the last time that the rounds were skipped.
+  size_t refills = 0;
+  while (!ring_.empty()) {
+    Lane* lane = ring_.front();
+    int64_t quantum = kQuantumUsec * lane->weight();
+
+    lane->deficit_usec_ -=
+        lane->correction_usec_.exchange(0, std::memory_order::relaxed);
+    lane->deficit_usec_ =
+        std::max(lane->deficit_usec_, -kMaxDebtQuanta * quantum);
+
+    if (lane->deficit_usec_ <= 0) {
+      if (refills >= ring_.size()) {
+        skip_rounds(lock);
+        refills = 0;
+      }
+      lane->deficit_usec_ += quantum;
+      refills++;
+      if (ring_.size() > 1) {
+        ring_.pop_front();
+        ring_.push_back(lane);
+      }
+      continue;
+    }
+
+    Task* task = lane->tasks_.front();
+    lane->tasks_.pop_front();
+
+    int64_t estimate = lane->estimate_usec_.load(std::memory_order::relaxed);
+    task->dispatch_estimate_usec_ = estimate;
+    lane->deficit_usec_ -= estimate;
+    THETA_PROBE2(dequeue, task->opts().executor(), task);
+
+    if (lane->tasks_.empty()) {
+      // Leaving the ring forfeits unused credit but keeps any debt.
+      ring_.pop_front();
+      lane->listed_ = false;
+      lane->deficit_usec_ = std::min<int64_t>(lane->deficit_usec_, 0);
+    }
+
+    return task;
+  }
+
+  return nullptr;
+}
+
+void RunQueue::skip_rounds(const std::lock_guard<std::mutex>&) {
+  int64_t rounds = std::numeric_limits<int64_t>::max();
+  for (Lane* lane : ring_) {
+    int64_t quantum = kQuantumUsec * lane->weight();
+    // The lane gets out of debt with its next refill after these rounds.
+    rounds = std::min(rounds, -lane->deficit_usec_ / quantum);
+  }
+  if (rounds <= 0) {
+    return;
+  }
+  for (Lane* lane : ring_) {
+    lane->deficit_usec_ += rounds * kQuantumUsec * lane->weight();
+  }
+}
+
+RunQueue::Lane* RunQueue::pop_ready(const std::lock_guard<std::mutex>&) {
+  Lane* lane = ready_head_;
+  if (!lane) {
+    return nullptr;
+  }
+  ready_head_ = lane->ready_next_;
+  if (!ready_head_) {
+    ready_tail_ = nullptr;
+  }
+  // Anything that becomes admissible from here on lists the lane again.
+  lane->ready_.store(false, std::memory_order::release);
+  return lane;
+}
+
+}  // namespace theta
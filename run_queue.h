@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#include "semaphore.h"
+#include "task.h"
+
+namespace theta {
+
+// The pool-wide queue of admitted tasks that are waiting for a worker.
+//
+// Every executor owns a Lane. Lanes that hold tasks sit in a ring that is
+// served with deficit round robin: the lane at the front may dispatch while
+// its deficit is positive, and each dispatch is debited an estimate of the
+// task's wall time. When the task finishes, the difference between the
+// estimate and the actual wall time is charged back to the lane. A lane that
+// runs out of deficit is refilled with kQuantumUsec * weight and rotated to
+// the back of the ring.
+//
+// Lanes without tasks are never visited and do not bank credit, so an
+// executor can use more than its share of the workers only when nobody else
+// wants them.
+//
+// A pop refills at most a couple of rounds of lanes one by one: once every
+// lane has been refilled and is still in debt, the rounds until the first
+// one gets out are added in one step, so the mutex is never held for
+// kMaxDebtQuanta rounds.
+//
+// Lanes whose executor has tasks that it could admit now, but that nobody is
+// about to admit, wait on a separate ready list. A waiting worker takes the
+// front lane off it and admits the tasks itself, so dispatch costs the same
+// however many executors there are.
+//
+// The pool keeps one RunQueue per NUMA node, each with its own workers. A
+// worker only runs a task from another node's queue when that node has no
+// worker to spare and the pool asks it to with request_steal().
+//
+// A few idle workers may spin for a while before they block, so that a push
+// that comes soon after the queue empties finds a worker awake and skips the
+// futex wake. Each spinner starts from a shared budget, which doubles when a
+// spin catches a task and halves when it runs out, so spinning backs off
+// while the gaps between tasks are longer than it could cover.
+class RunQueue {
+ public:
+  static constexpr int64_t kQuantumUsec = 1000;
+  // Bounds how long a lane that ran one very long task is kept out.
+  static constexpr int64_t kMaxDebtQuanta = 100;
+  // The spin budget never drops below max_spin / kMinSpinDivisor, so that
+  // it can grow back when tasks come closer together.
+  static constexpr int64_t kMinSpinDivisor = 32;
+
+  class Lane {
+    friend class RunQueue;
+
+   public:
+    // admit is called by a worker that takes the lane off the ready list,
+    // and should move the executor's admissible tasks onto the run queue.
+    explicit Lane(size_t weight, std::function<void()> admit = nullptr)
+        : weight_(std::max<size_t>(1, weight)), admit_(std::move(admit)) {}
+
+    size_t weight() const { return weight_.load(std::memory_order::relaxed); }
+    void set_weight(size_t val) {
+      weight_.store(std::max<size_t>(1, val), std::memory_order::relaxed);
+    }
+
+   private:
+    static constexpr int64_t kInitialEstimateUsec = 100;
+
+    std::atomic<size_t> weight_;
+    const std::function<void()> admit_;
+
+    // These are only accessed while holding RunQueue::mu_.
+    std::deque<Task*> tasks_;
+    int64_t deficit_usec_{0};
+    bool listed_{false};
+    Lane* ready_next_{nullptr};
+
+    std::atomic<bool> ready_{false};
+
+    std::atomic<int64_t> correction_usec_{0};
+    std::atomic<int64_t> estimate_usec_{kInitialEstimateUsec};
+  };
+
+  RunQueue() : sem_(0) {}
+
+  void shutdown() {
+    if (!shutdown_.exchange(true, std::memory_order::acq_rel)) {
+      sem_.release(std::numeric_limits<int32_t>::max() / 2);
+    }
+  }
+
+  bool is_shutting_down() const {
+    return shutdown_.load(std::memory_order_acquire);
+  }
+
+  void push(Lane* lane, std::unique_ptr<Task> task);
+
+  // Puts lane on the ready list and wakes a worker to admit its tasks. Does
+  // nothing if the lane is already on the list.
+  void mark_ready(Lane* lane);
+
+  // Wakes one worker of this queue to run a task of another queue, for a
+  // push there that found no idle worker of its own.
+  void request_steal();
+
+  std::unique_ptr<Task> maybe_pop();
+  std::unique_ptr<Task> wait_pop();
+  // Returns nullptr if the deadline passes or the queue shuts down.
+  std::unique_ptr<Task> wait_pop_until(
+      std::chrono::system_clock::time_point deadline);
+
+  // Takes the next task for a worker of another queue. Ready lanes are left
+  // to this queue's workers. Returns nullptr if there is no task.
+  std::unique_ptr<Task> steal();
+
+  size_t size() const { return size_.load(std::memory_order::acquire); }
+
+  // The number of workers that are blocked waiting for a task.
+  size_t idle_workers() const {
+    return idle_workers_.load(std::memory_order::acquire);
+  }
+
+  // Lets up to max_spinners idle workers spin for up to max_spin before they
+  // block. A zero max_spin, the default, turns spinning off. Applies to
+  // workers the next time that they go idle.
+  void set_idle_spin(std::chrono::microseconds max_spin, size_t max_spinners);
+
+  // Called after a push finds no idle worker, so that the pool can start
+  // another one. Must be set before the first push.
+  void set_starved_callback(std::function<void()> val) {
+    starved_callback_ = std::move(val);
+  }
+
+  // Called by a worker that request_steal() woke, to take a task from
+  // another queue. Must be set before the first request_steal().
+  void set_steal_callback(std::function<std::unique_ptr<Task>()> val) {
+    steal_callback_ = std::move(val);
+  }
+
+  // Called when a task that belongs to lane finishes. The wall time includes
+  // tasks that never went through the run queue, so an executor that keeps a
+  // worker to itself still pays for it.
+  static void charge(Lane* lane, Task* task, int64_t wall_usec);
+
+ private:
+  Semaphore sem_;
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> idle_workers_{0};
+  std::atomic<bool> shutdown_{false};
+  // Each request holds one semaphore token, like a task or a ready lane.
+  std::atomic<size_t> steal_requests_{0};
+
+  std::atomic<int64_t> max_spin_nsec_{0};
+  std::atomic<size_t> max_spinners_{0};
+  std::atomic<size_t> spinners_{0};
+  std::atomic<int64_t> spin_budget_nsec_{0};
+  std::function<void()> starved_callback_{nullptr};
+  std::function<std::unique_ptr<Task>()> steal_callback_{nullptr};
+
+  std::mutex mu_;
+  std::deque<Lane*> ring_;
+  // Intrusive FIFO through Lane::ready_next_.
+  Lane* ready_head_{nullptr};
+  Lane* ready_tail_{nullptr};
+
+  void wake();
+  // Spins for a semaphore token if spinning is on and few enough workers
+  // are spinning already. Returns whether it got one.
+  bool spin_acquire();
+  // Spends a semaphore token. Returns a task, possibly stolen for a steal
+  // request, or nullptr if the token went to admitting a ready lane or
+  // nothing was there, in which case the token is given back.
+  Task* take_token();
+  bool take_steal_request();
+  Task* pop(const std::lock_guard<std::mutex>&);
+  // Adds the rounds of quanta that every lane on the ring would get before
+  // any of them is out of debt.
+  void skip_rounds(const std::lock_guard<std::mutex>&);
+  Lane* pop_ready(const std::lock_guard<std::mutex>&);
+};
+
+}  // namespace theta
@@ -0,0 +1,240 @@
+#include "run_queue.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+std::unique_ptr<Task> make_task() {
+  return std::make_unique<Task>(Task::Opts{}.set_func([]() {}));
+}
+
+}  // namespace
+
+TEST(RunQueue, waiting_worker_admits_a_ready_lane) {
+  RunQueue run_queue;
+  int admitted = 0;
+  RunQueue::Lane lane{1, [&]() {
+                        admitted++;
+                        run_queue.push(&lane, make_task());
+                      }};
+
+  run_queue.mark_ready(&lane);
+  // Already listed.
+  run_queue.mark_ready(&lane);
+
+  auto task = run_queue.wait_pop_until(std::chrono::system_clock::now() + 1s);
+  EXPECT_NE(task, nullptr);
+  EXPECT_EQ(admitted, 1);
+  EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+}
+
+TEST(RunQueue, lane_can_be_listed_again_once_admitted) {
+  RunQueue run_queue;
+  int admitted = 0;
+  RunQueue::Lane lane{1, [&]() { admitted++; }};
+
+  for (int i = 0; i < 3; i++) {
+    run_queue.mark_ready(&lane);
+    // Admitting pushes nothing here, so the token is spent with no task.
+    EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+    EXPECT_EQ(admitted, i + 1);
+  }
+}
+
+TEST(RunQueue, ready_lanes_are_admitted_in_order) {
+  static constexpr int kLanes = 1000;
+
+  RunQueue run_queue;
+  std::vector<int> order;
+  std::vector<std::unique_ptr<RunQueue::Lane>> lanes;
+  for (int i = 0; i < kLanes; i++) {
+    lanes.push_back(std::make_unique<RunQueue::Lane>(
+        1, [&order, i]() { order.push_back(i); }));
+  }
+  for (auto& lane : lanes) {
+    run_queue.mark_ready(lane.get());
+  }
+
+  for (int i = 0; i < kLanes; i++) {
+    EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+  }
+  ASSERT_EQ(order.size(), kLanes);
+  for (int i = 0; i < kLanes; i++) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+TEST(RunQueue, steal_takes_a_task_but_leaves_ready_lanes) {
+  RunQueue run_queue;
+  int admitted = 0;
+  RunQueue::Lane ready{1, [&]() { admitted++; }};
+  RunQueue::Lane lane{1};
+
+  run_queue.mark_ready(&ready);
+  EXPECT_EQ(run_queue.steal(), nullptr);
+  EXPECT_EQ(admitted, 0);
+
+  run_queue.push(&lane, make_task());
+  EXPECT_NE(run_queue.steal(), nullptr);
+  EXPECT_EQ(run_queue.size(), 0);
+
+  // The ready lane still has its token.
+  EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+  EXPECT_EQ(admitted, 1);
+}
+
+TEST(RunQueue, steal_request_runs_a_task_of_another_queue) {
+  RunQueue local;
+  RunQueue remote;
+  RunQueue::Lane lane{1};
+  local.set_steal_callback([&]() { return remote.steal(); });
+
+  remote.push(&lane, make_task());
+  local.request_steal();
+
+  auto task = local.wait_pop_until(std::chrono::system_clock::now() + 1s);
+  EXPECT_NE(task, nullptr);
+  EXPECT_EQ(remote.size(), 0);
+  // The request was used up.
+  EXPECT_EQ(local.maybe_pop(), nullptr);
+}
+
+TEST(RunQueue, steal_request_with_nothing_to_steal_is_dropped) {
+  RunQueue local;
+  int steals = 0;
+  local.set_steal_callback([&]() -> std::unique_ptr<Task> {
+    steals++;
+    return nullptr;
+  });
+
+  local.request_steal();
+  EXPECT_EQ(local.maybe_pop(), nullptr);
+  EXPECT_EQ(local.maybe_pop(), nullptr);
+  EXPECT_EQ(steals, 1);
+}
+
+TEST(RunQueue, lanes_in_debt_get_out_by_weight) {
+  RunQueue run_queue;
+  RunQueue::Lane light{1};
+  RunQueue::Lane heavy{4};
+
+  // Each lane ran a task that took 50 quanta, so the light lane needs four
+  // times as many rounds to pay it back.
+  for (auto* lane : {&light, &heavy}) {
+    run_queue.push(lane, make_task());
+    auto task = run_queue.maybe_pop();
+    ASSERT_NE(task, nullptr);
+    RunQueue::charge(lane, task.get(), 50 * RunQueue::kQuantumUsec);
+  }
+
+  auto light_task = make_task();
+  auto heavy_task = make_task();
+  Task* light_ptr = light_task.get();
+  Task* heavy_ptr = heavy_task.get();
+  run_queue.push(&light, std::move(light_task));
+  run_queue.push(&heavy, std::move(heavy_task));
+
+  EXPECT_EQ(run_queue.maybe_pop().get(), heavy_ptr);
+  EXPECT_EQ(run_queue.maybe_pop().get(), light_ptr);
+  EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+}
+
+TEST(RunQueue, concurrent_lanes_lose_no_task) {
+  static constexpr int kLanes = 4;
+  static constexpr int kPoppers = 4;
+  static constexpr int kPerLane = 20000;
+
+  RunQueue run_queue;
+  std::vector<std::unique_ptr<RunQueue::Lane>> lanes;
+  for (int i = 0; i < kLanes; i++) {
+    lanes.push_back(std::make_unique<RunQueue::Lane>(i + 1));
+  }
+
+  std::atomic<int> popped{0};
+  std::vector<std::thread> threads;
+  for (auto& lane : lanes) {
+    threads.emplace_back([&, lane = lane.get()]() {
+      for (int i = 0; i < kPerLane; i++) {
+        run_queue.push(lane, make_task());
+      }
+    });
+  }
+  for (int i = 0; i < kPoppers; i++) {
+    threads.emplace_back([&]() {
+      while (popped.load(std::memory_order::relaxed) < kLanes * kPerLane) {
+        if (run_queue.maybe_pop()) {
+          popped.fetch_add(1, std::memory_order::relaxed);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(popped.load(), kLanes * kPerLane);
+  EXPECT_EQ(run_queue.size(), 0);
+  EXPECT_EQ(run_queue.maybe_pop(), nullptr);
+}
+
+TEST(RunQueue, spinning_worker_takes_a_push) {
+  RunQueue run_queue;
+  RunQueue::Lane lane{1};
+  run_queue.set_idle_spin(std::chrono::seconds{10}, 1);
+
+  std::unique_ptr<Task> task;
+  std::thread worker{[&]() {
+    task = run_queue.wait_pop_until(std::chrono::system_clock::now() + 10s);
+  }};
+  while (run_queue.idle_workers() == 0) {
+    std::this_thread::yield();
+  }
+  run_queue.push(&lane, make_task());
+  worker.join();
+
+  EXPECT_NE(task, nullptr);
+  EXPECT_EQ(run_queue.size(), 0);
+}
+
+TEST(RunQueue, spin_falls_back_to_blocking) {
+  RunQueue run_queue;
+  RunQueue::Lane lane{1};
+  run_queue.set_idle_spin(std::chrono::microseconds{100}, 1);
+
+  std::unique_ptr<Task> task;
+  std::thread worker{[&]() {
+    task = run_queue.wait_pop_until(std::chrono::system_clock::now() + 10s);
+  }};
+  // Long after the spin budget ran out.
+  std::this_thread::sleep_for(50ms);
+  run_queue.push(&lane, make_task());
+  worker.join();
+
+  EXPECT_NE(task, nullptr);
+}
+
+TEST(RunQueue, spinning_worker_sees_shutdown) {
+  RunQueue run_queue;
+  run_queue.set_idle_spin(std::chrono::seconds{10}, 1);
+
+  std::thread worker{[&]() { EXPECT_EQ(run_queue.wait_pop(), nullptr); }};
+  while (run_queue.idle_workers() == 0) {
+    std::this_thread::yield();
+  }
+  run_queue.shutdown();
+  worker.join();
+}
+
+}  // namespace theta
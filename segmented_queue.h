@@ -0,0 +1,253 @@
+#pragma once
+
+#include <glog/logging.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+
+#include "HyperSharedPointer.h"
+#include "queue.h"
+
+namespace theta {
+
+// An unbounded lock-free MPMC FIFO queue of pointers.
+//
+// The queue is a linked list of fixed-size segments. Pushers and poppers
+// claim a slot in the tail or head segment with a fetch_add, so a push or a
+// pop is one fetch_add plus one exchange or CAS on a slot, whatever the
+// backlog. A popper that reaches a slot before its pusher marks the slot as
+// taken, and the pusher tries again with a new slot. Whoever fills the tail
+// segment links a new one.
+//
+// Every push and pop holds the queue's current pin for as long as it reads
+// segments. Moving the head off a segment retires the segment to the current
+// pin and swaps in a new pin, which the old one keeps alive. The segment is
+// freed once the last operation that held that pin or an older one is done.
+// Pins belong to one queue, so an idle queue holds no memory but its own
+// live segments.
+//
+// Swapping pins is serialized by a mutex, which is only ever try-locked. A
+// popper that finds it taken leaves its segment on a lock-free list, which
+// the holder drains before it lets go. Neither push nor pop ever blocks.
+template <typename T, size_t kSegmentSize = 128>
+class SegmentedQueue {
+  static_assert(std::is_pointer_v<T>, "Slots store pointers");
+  static_assert(alignof(std::remove_pointer_t<T>) > 1,
+                "The low bit of a slot marks it as taken");
+
+ public:
+  SegmentedQueue() : pin_(new Pin{&num_segments_}) {
+    Segment* segment = new_segment(/*val=*/nullptr);
+    head_.store(segment, std::memory_order::relaxed);
+    tail_.store(segment, std::memory_order::relaxed);
+  }
+
+  ~SegmentedQueue() {
+    // Retired segments go with the pins.
+    DCHECK(!unpinned_.load(std::memory_order::acquire));
+    Segment* segment = head_.load(std::memory_order::acquire);
+    while (segment) {
+      Segment* next = segment->next.load(std::memory_order::acquire);
+      delete_segment(segment);
+      segment = next;
+    }
+  }
+
+  SegmentedQueue(const SegmentedQueue&) = delete;
+  SegmentedQueue& operator=(const SegmentedQueue&) = delete;
+
+  void push(T val) {
+    auto pin = pin_.get();
+    while (true) {
+      Segment* tail = tail_.load(std::memory_order::acquire);
+      uint64_t index =
+          tail->push_index.fetch_add(1, std::memory_order::acq_rel);
+      if (index < kSegmentSize) {
+        uintptr_t expected = kEmpty;
+        if (tail->slots[index].compare_exchange_strong(
+                expected, reinterpret_cast<uintptr_t>(val),
+                std::memory_order::release, std::memory_order::relaxed)) {
+          return;
+        }
+        // A popper gave up on the slot before this got to it.
+        continue;
+      }
+
+      if (tail != tail_.load(std::memory_order::acquire)) {
+        continue;
+      }
+      Segment* next = tail->next.load(std::memory_order::acquire);
+      if (next) {
+        tail_.compare_exchange_strong(tail, next, std::memory_order::acq_rel);
+        continue;
+      }
+
+      Segment* segment = new_segment(val);
+      if (tail->next.compare_exchange_strong(next, segment,
+                                             std::memory_order::acq_rel,
+                                             std::memory_order::acquire)) {
+        tail_.compare_exchange_strong(tail, segment,
+                                      std::memory_order::acq_rel);
+        return;
+      }
+      // Another pusher linked its segment first. This one was never seen.
+      delete_segment(segment);
+    }
+  }
+
+  std::optional<T> try_pop() {
+    auto pin = pin_.get();
+    while (true) {
+      Segment* head = head_.load(std::memory_order::acquire);
+      if (head->pop_index.load(std::memory_order::acquire) >=
+              head->push_index.load(std::memory_order::acquire) &&
+          !head->next.load(std::memory_order::acquire)) {
+        return {};
+      }
+
+      uint64_t index = head->pop_index.fetch_add(1, std::memory_order::acq_rel);
+      if (index < kSegmentSize) {
+        uintptr_t val =
+            head->slots[index].exchange(kTaken, std::memory_order::acquire);
+        if (val == kEmpty) {
+          // The slot's pusher has not stored yet. It will find the slot
+          // taken and push again.
+          continue;
+        }
+        return reinterpret_cast<T>(val);
+      }
+
+      Segment* next = head->next.load(std::memory_order::acquire);
+      if (!next) {
+        return {};
+      }
+      // The tail must move past the head before the head can be retired.
+      Segment* tail = head;
+      tail_.compare_exchange_strong(tail, next, std::memory_order::acq_rel);
+      if (head_.compare_exchange_strong(head, next,
+                                        std::memory_order::acq_rel)) {
+        retire(head);
+      }
+    }
+  }
+
+  // The number of segments that are not freed yet, including retired ones
+  // that a pin still holds.
+  size_t num_segments() const {
+    return num_segments_.load(std::memory_order::acquire);
+  }
+
+ private:
+  static constexpr uintptr_t kEmpty = 0;
+  static constexpr uintptr_t kTaken = 1;
+
+  struct Segment {
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> pop_index{0};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<uint64_t> push_index{0};
+    alignas(hardware_destructive_interference_size)
+        std::atomic<Segment*> next{nullptr};
+    std::array<std::atomic<uintptr_t>, kSegmentSize> slots{};
+    // Links retired segments. Operations with an old pin may still follow
+    // next, so retiring leaves it alone.
+    Segment* retired_next{nullptr};
+  };
+
+  struct Pin {
+    std::atomic<size_t>* num_segments;
+    // The segments that were retired while this was the current pin, linked
+    // through retired_next. Operations that hold an older pin keep this one
+    // alive.
+    Segment* retired{nullptr};
+    hsp::HyperSharedPointer<Pin> next{nullptr};
+
+    ~Pin() {
+      std::atomic_thread_fence(std::memory_order::acquire);
+      while (retired) {
+        Segment* segment = retired;
+        retired = segment->retired_next;
+        delete segment;
+        num_segments->fetch_sub(1, std::memory_order::acq_rel);
+      }
+
+      // Releasing next can free it, and with it the pin after it, and so on
+      // for every segment retired while an old pin was held. A pin freed
+      // from inside this loop hands its next back instead of releasing it,
+      // so the chain is freed one pin at a time rather than recursively.
+      thread_local bool unlinking = false;
+      thread_local hsp::HyperSharedPointer<Pin> handed_back{nullptr};
+      if (unlinking) {
+        handed_back = std::move(next);
+        return;
+      }
+      unlinking = true;
+      hsp::HyperSharedPointer<Pin> pin = std::move(next);
+      while (pin) {
+        pin.reset();
+        pin = std::move(handed_back);
+      }
+      unlinking = false;
+    }
+  };
+
+  std::atomic<size_t> num_segments_{0};
+  // Mutable, since reads hold a pin as well.
+  mutable hsp::KeepAlive<Pin> pin_{nullptr};
+  // Serializes swapping pins. Only ever try-locked.
+  std::mutex pin_mu_;
+  // Segments whose retirer found pin_mu_ taken, linked through
+  // retired_next.
+  std::atomic<Segment*> unpinned_{nullptr};
+
+  alignas(hardware_destructive_interference_size) std::atomic<Segment*> head_;
+  alignas(hardware_destructive_interference_size) std::atomic<Segment*> tail_;
+
+  Segment* new_segment(T val) {
+    auto* segment = new Segment{};
+    if (val) {
+      segment->slots[0].store(reinterpret_cast<uintptr_t>(val),
+                              std::memory_order::relaxed);
+      segment->push_index.store(1, std::memory_order::relaxed);
+    }
+    num_segments_.fetch_add(1, std::memory_order::acq_rel);
+    return segment;
+  }
+
+  void delete_segment(Segment* segment) {
+    delete segment;
+    num_segments_.fetch_sub(1, std::memory_order::acq_rel);
+  }
+
+  // Called once per segment, by the thread that moved the head off it.
+  // Retiring to a pin newer than the one that was current when the head
+  // moved only frees the segment later.
+  void retire(Segment* segment) {
+    Segment* head = unpinned_.load(std::memory_order::relaxed);
+    do {
+      segment->retired_next = head;
+    } while (!unpinned_.compare_exchange_weak(head, segment,
+                                              std::memory_order::release,
+                                              std::memory_order::relaxed));
+
+    // Whoever holds the mutex checks the list again after releasing it, so
+    // a segment is never left behind.
+    while (unpinned_.load(std::memory_order::acquire) && pin_mu_.try_lock()) {
+      Segment* retired =
+          unpinned_.exchange(nullptr, std::memory_order::acquire);
+      if (retired) {
+        auto pin = pin_.get();
+        pin->retired = retired;
+        pin->next = pin_.reset(new Pin{&num_segments_});
+      }
+      pin_mu_.unlock();
+    }
+  }
+};
+
+}  // namespace theta
@@ -0,0 +1,133 @@
+#include "segmented_queue.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+TEST(SegmentedQueue, empty) {
+  SegmentedQueue<int*> queue;
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(SegmentedQueue, fifo_across_segments) {
+  static constexpr int kNum = 1000;
+  SegmentedQueue<int*, 8> queue;
+  std::vector<int> vals(kNum);
+  for (int i = 0; i < kNum; i++) {
+    queue.push(&vals[i]);
+  }
+
+  for (int i = 0; i < kNum; i++) {
+    auto val = queue.try_pop();
+    ASSERT_TRUE(val.has_value());
+    EXPECT_EQ(val.value(), &vals[i]);
+  }
+  EXPECT_FALSE(queue.try_pop().has_value());
+}
+
+TEST(SegmentedQueue, interleaved_push_and_pop) {
+  SegmentedQueue<int*, 4> queue;
+  std::vector<int> vals(100);
+  int next_push = 0;
+  int next_pop = 0;
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 5; i++) {
+      queue.push(&vals[next_push++]);
+    }
+    for (int i = 0; i < 5; i++) {
+      auto val = queue.try_pop();
+      ASSERT_TRUE(val.has_value());
+      EXPECT_EQ(val.value(), &vals[next_pop++]);
+    }
+    EXPECT_FALSE(queue.try_pop().has_value());
+  }
+}
+
+TEST(SegmentedQueue, frees_retired_segments) {
+  static constexpr int kRounds = 10000;
+  std::vector<int> vals(4);
+
+  // Holds an item, and is never touched again.
+  SegmentedQueue<int*, 4> idle;
+  idle.push(&vals[0]);
+
+  SegmentedQueue<int*, 4> busy;
+  for (int round = 0; round < kRounds; round++) {
+    for (int& val : vals) {
+      busy.push(&val);
+    }
+    for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(busy.try_pop().has_value());
+    }
+  }
+
+  // Only the head and the tail are left, since nothing holds a pin.
+  EXPECT_LE(busy.num_segments(), 2u);
+  EXPECT_EQ(idle.num_segments(), 1u);
+  EXPECT_EQ(idle.try_pop().value(), &vals[0]);
+}
+
+TEST(SegmentedQueue, mpmc) {
+  static constexpr int kProducers = 4;
+  static constexpr int kConsumers = 4;
+  static constexpr int kPerProducer = 100000;
+
+  struct Item {
+    int producer;
+    int seq;
+  };
+  std::vector<std::vector<Item>> items(kProducers);
+  for (int p = 0; p < kProducers; p++) {
+    for (int i = 0; i < kPerProducer; i++) {
+      items[p].push_back(Item{p, i});
+    }
+  }
+
+  SegmentedQueue<Item*, 16> queue;
+  std::atomic<int> popped{0};
+  std::atomic<bool> ordered{true};
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; p++) {
+    threads.emplace_back([&, p]() {
+      for (auto& item : items[p]) {
+        queue.push(&item);
+      }
+    });
+  }
+  for (int c = 0; c < kConsumers; c++) {
+    threads.emplace_back([&]() {
+      // Each producer's items must come out in its push order, as seen by
+      // any one consumer.
+      std::vector<int> last(kProducers, -1);
+      while (popped.load(std::memory_order::relaxed) <
+             kProducers * kPerProducer) {
+        auto item = queue.try_pop();
+        if (!item) {
+          continue;
+        }
+        if ((*item)->seq <= last[(*item)->producer]) {
+          ordered.store(false);
+        }
+        last[(*item)->producer] = (*item)->seq;
+        popped.fetch_add(1, std::memory_order::relaxed);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(popped.load(), kProducers * kPerProducer);
+  EXPECT_TRUE(ordered.load());
+  EXPECT_FALSE(queue.try_pop().has_value());
+  EXPECT_LE(queue.num_segments(), 2u);
+}
+
+}  // namespace theta
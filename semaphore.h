@@ -1,9 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <semaphore>
 
+#include "probes.h"
+
 namespace theta {
 
 // The acquire method can sleep forever, so use try_acquire_for in a loop
@@ -45,8 +49,28 @@ class Semaphore {
   void acquire() {
     while (!try_acquire()) {
       d_.waiters.fetch_add(1, std::memory_order::acq_rel);
+      THETA_PROBE1(sem_park, this);
       semaphoreAcquireKludge(sem_);
+      THETA_PROBE1(sem_unpark, this);
+    }
+  }
+
+  // Returns false if the deadline passed before the count could be
+  // decremented.
+  bool try_acquire_until(std::chrono::system_clock::time_point deadline) {
+    while (!try_acquire()) {
+      auto now = std::chrono::system_clock::now();
+      if (now >= deadline) {
+        return false;
+      }
+      d_.waiters.fetch_add(1, std::memory_order::acq_rel);
+      THETA_PROBE1(sem_park, this);
+      // See semaphoreAcquireKludge for why this never waits for long.
+      sem_.try_acquire_until(
+          std::min(deadline, now + std::chrono::milliseconds(100)));
+      THETA_PROBE1(sem_unpark, this);
     }
+    return true;
   }
 
   bool try_acquire() {
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <mutex>
+#include <utility>
+
+#include "HyperSharedPointer.h"
+
+namespace theta {
+
+// A value that is read far more often than it changes, e.g. configuration.
+// Versions are immutable. Readers take a Ref to the current version without
+// a lock, and the Ref keeps that version alive. A version is freed once a
+// newer one was published and the last Ref to it is gone, so updating often
+// does not pile up copies of T. The versions live in an hsp::KeepAlive, as
+// Epoch's pools do.
+template <typename T>
+class Snapshot {
+ public:
+  class Ref {
+   public:
+    const T& operator*() const { return *ptr_; }
+    const T* operator->() const { return &*ptr_; }
+
+   private:
+    friend class Snapshot;
+
+    explicit Ref(hsp::HyperSharedPointer<T> ptr) : ptr_(std::move(ptr)) {}
+
+    hsp::HyperSharedPointer<T> ptr_;
+  };
+
+  explicit Snapshot(T val = T{}) : current_(new T(std::move(val))) {}
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  Ref get() const { return Ref{current_.get()}; }
+  // The Ref lives until the end of the full expression, e.g. in
+  // snapshot->field().
+  Ref operator->() const { return get(); }
+
+  Ref publish(T val) {
+    std::lock_guard l{mu_};
+    return publish(l, std::move(val));
+  }
+
+  // Publishes a copy of the current version that f changed. Updates are
+  // serialized, so concurrent updates of different fields are not lost.
+  template <typename F>
+  Ref update(F&& f) {
+    std::lock_guard l{mu_};
+    T next = *current_.get();
+    f(next);
+    return publish(l, std::move(next));
+  }
+
+ private:
+  std::mutex mu_;
+  // Mutable, since taking a Ref counts a reference.
+  mutable hsp::KeepAlive<T> current_;
+
+  Ref publish(const std::lock_guard<std::mutex>&, T val) {
+    return Ref{current_.reset(new T(std::move(val)))};
+  }
+};
+
+}  // namespace theta
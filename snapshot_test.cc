@@ -0,0 +1,107 @@
+#include "snapshot.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+namespace {
+
+struct Config {
+  int limit{0};
+  int weight{0};
+  std::string name;
+};
+
+}  // namespace
+
+TEST(Snapshot, publish_replaces_the_current_version) {
+  Snapshot<Config> config{Config{.limit = 1, .name = "a"}};
+  auto old = config.get();
+
+  config.publish(Config{.limit = 2, .name = "b"});
+
+  EXPECT_EQ(config->limit, 2);
+  EXPECT_EQ(config->name, "b");
+  // Readers of the old version are not disturbed.
+  EXPECT_EQ(old->limit, 1);
+  EXPECT_EQ(old->name, "a");
+}
+
+TEST(Snapshot, update_changes_a_copy) {
+  Snapshot<Config> config{Config{.limit = 1, .weight = 1}};
+
+  auto next = config.update([](Config& c) { c.weight = 5; });
+
+  EXPECT_EQ(&*next, &*config.get());
+  EXPECT_EQ(next->limit, 1);
+  EXPECT_EQ(next->weight, 5);
+}
+
+TEST(Snapshot, replaced_versions_are_freed) {
+  struct Tracked {
+    // Every live version holds a copy.
+    std::shared_ptr<int> token;
+    int version{0};
+  };
+  auto token = std::make_shared<int>(0);
+  Snapshot<Tracked> tracked{Tracked{.token = token}};
+
+  for (int i = 1; i <= 100; i++) {
+    tracked.update([](Tracked& t) { t.version++; });
+  }
+  EXPECT_EQ(tracked->version, 100);
+  EXPECT_EQ(token.use_count(), 2);
+
+  // A reader keeps its version until it lets go of it.
+  auto old = tracked.get();
+  tracked.update([](Tracked& t) { t.version++; });
+  EXPECT_EQ(token.use_count(), 3);
+  EXPECT_EQ(old->version, 100);
+  old = tracked.get();
+  EXPECT_EQ(token.use_count(), 2);
+}
+
+TEST(Snapshot, concurrent_updates_are_not_lost) {
+  static constexpr int kThreads = 4;
+  static constexpr int kUpdates = 1000;
+
+  Snapshot<Config> config;
+  std::atomic<bool> done{false};
+  // Every version that a reader sees is whole: limit and weight are always
+  // updated together.
+  std::thread reader{[&]() {
+    while (!done.load(std::memory_order::acquire)) {
+      auto c = config.get();
+      EXPECT_EQ(c->limit, c->weight);
+    }
+  }};
+
+  std::vector<std::thread> writers;
+  for (int i = 0; i < kThreads; i++) {
+    writers.emplace_back([&]() {
+      for (int j = 0; j < kUpdates; j++) {
+        config.update([](Config& c) {
+          c.limit++;
+          c.weight++;
+        });
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  done.store(true, std::memory_order::release);
+  reader.join();
+
+  EXPECT_EQ(config->limit, kThreads * kUpdates);
+}
+
+}  // namespace theta
@@ -0,0 +1,56 @@
+#include <atomic>
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "executor.h"
+
+namespace theta {
+
+// The counters as they were before ExecutorStats was sharded per CPU: one
+// unpadded set of atomics that every worker updates.
+struct SharedStats {
+  std::atomic<uint32_t> waiting_num{0};
+  std::atomic<uint32_t> running_num{0};
+  std::atomic<uint32_t> throttled_num{0};
+  std::atomic<uint64_t> finished_num{0};
+
+  void waiting_delta(int val) {
+    waiting_num.fetch_add(val, std::memory_order::acq_rel);
+  }
+  void running_delta(int val) {
+    running_num.fetch_add(val, std::memory_order::acq_rel);
+  }
+  void finished_delta(int val) {
+    finished_num.fetch_add(val, std::memory_order::acq_rel);
+  }
+};
+
+// Each iteration makes the counter updates of one task that is posted, runs
+// and finishes, which is what a worker pays per task.
+template <typename StatsType>
+static void BM_task_stats(benchmark::State &state) {
+  static StatsType stats;
+
+  for (auto _ : state) {
+    stats.waiting_delta(1);
+    stats.waiting_delta(-1);
+    stats.running_delta(1);
+    stats.running_delta(-1);
+    stats.finished_delta(1);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_task_stats, SharedStats)
+    ->Threads(1)
+    ->Threads(8)
+    ->Threads(64);
+BENCHMARK_TEMPLATE(BM_task_stats, ExecutorStats)
+    ->Threads(1)
+    ->Threads(8)
+    ->Threads(64);
+
+}  // namespace theta
+
+BENCHMARK_MAIN();
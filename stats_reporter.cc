@@ -0,0 +1,278 @@
+#include "stats_reporter.h"
+
+#include <glog/logging.h>
+
+#include <cstdio>
+#include <fstream>
+
+namespace theta {
+
+namespace {
+
+constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+std::string format_number(double val) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", val);
+  return buf;
+}
+
+std::string escape_label(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (char c : s) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+std::string escape_json(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (char c : s) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+struct Gauge {
+  const char* name;
+  const char* type;
+  const char* help;
+  double (*value)(const ExecutorSnapshot&);
+};
+
+const Gauge kGauges[] = {
+    {"theta_executor_thread_weight", "gauge",
+     "The executor's share of the CPUs relative to other executors.",
+     [](const ExecutorSnapshot& s) -> double { return s.thread_weight; }},
+    {"theta_executor_worker_limit", "gauge",
+     "The most workers that the executor may use at once.",
+     [](const ExecutorSnapshot& s) -> double { return s.worker_limit; }},
+    {"theta_executor_active", "gauge",
+     "Tasks that hold an active slot.",
+     [](const ExecutorSnapshot& s) -> double { return s.active_num; }},
+    {"theta_executor_active_limit", "gauge",
+     "The number of active slots that the scaler granted.",
+     [](const ExecutorSnapshot& s) -> double { return s.active_limit; }},
+    {"theta_executor_running_limit", "gauge",
+     "Active tasks that may run at normal priority.",
+     [](const ExecutorSnapshot& s) -> double { return s.running_limit; }},
+    {"theta_executor_waiting", "gauge",
+     "Tasks that are posted but not yet running.",
+     [](const ExecutorSnapshot& s) -> double { return s.waiting_num; }},
+    {"theta_executor_running", "gauge",
+     "Tasks that are running at normal priority.",
+     [](const ExecutorSnapshot& s) -> double { return s.running_num; }},
+    {"theta_executor_throttled", "gauge",
+     "Tasks that are running at throttled priority.",
+     [](const ExecutorSnapshot& s) -> double { return s.throttled_num; }},
+    {"theta_executor_blocked", "gauge",
+     "Tasks that are inside of a ScopedBlocking region.",
+     [](const ExecutorSnapshot& s) -> double { return s.blocked_num; }},
+    {"theta_executor_finished_total", "counter",
+     "Tasks that have finished.",
+     [](const ExecutorSnapshot& s) -> double { return s.finished_num; }},
+    {"theta_executor_expired_total", "counter",
+     "Tasks that ran their expire callback instead of their func.",
+     [](const ExecutorSnapshot& s) -> double { return s.expired_num; }},
+    {"theta_executor_usage_proportion", "gauge",
+     "EMA of the proportion of a task's wall time that is spent on a CPU.",
+     [](const ExecutorSnapshot& s) { return s.ema_usage_proportion; }},
+    {"theta_executor_nivcsw_per_task", "gauge",
+     "EMA of involuntary context switches per task.",
+     [](const ExecutorSnapshot& s) { return s.ema_nivcsw_per_task; }},
+    {"theta_executor_completions_per_second", "gauge",
+     "EMA of tasks finished per second.",
+     [](const ExecutorSnapshot& s) { return s.ema_completions_per_sec; }},
+};
+
+struct Summary {
+  const char* name;
+  const char* help;
+  const Histogram& (*value)(const ExecutorSnapshot&);
+};
+
+const Summary kSummaries[] = {
+    {"theta_executor_queue_delay_seconds",
+     "Time from post until a worker starts the task.",
+     [](const ExecutorSnapshot& s) -> const Histogram& {
+       return s.queue_delay_usec;
+     }},
+    {"theta_executor_run_time_seconds",
+     "Time from when a worker starts the task until it returns.",
+     [](const ExecutorSnapshot& s) -> const Histogram& {
+       return s.run_time_usec;
+     }},
+};
+
+std::string histogram_json(const Histogram& h) {
+  std::string s{"{"};
+  s += "\"count\":" + std::to_string(h.count());
+  s += ",\"mean\":" + format_number(h.mean());
+  s += ",\"p50\":" + std::to_string(h.percentile(50.0));
+  s += ",\"p90\":" + std::to_string(h.percentile(90.0));
+  s += ",\"p99\":" + std::to_string(h.percentile(99.0));
+  s += ",\"p999\":" + std::to_string(h.percentile(99.9));
+  s += ",\"max\":" + std::to_string(h.max());
+  s += "}";
+  return s;
+}
+
+}  // namespace
+
+StatsReporter::StatsReporter(SnapshotFunc snapshot_func, Sink sink,
+                             Format format, std::chrono::milliseconds interval)
+    : snapshot_func_(std::move(snapshot_func)),
+      sink_(std::move(sink)),
+      format_(format),
+      interval_(interval),
+      thread_(&StatsReporter::run_loop, this) {
+  CHECK(snapshot_func_);
+  CHECK(sink_);
+  CHECK_GT(interval_.count(), 0) << "A zero interval would report nonstop";
+}
+
+StatsReporter::~StatsReporter() {
+  {
+    std::lock_guard l{mutex_};
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void StatsReporter::run_loop() {
+  while (true) {
+    {
+      std::unique_lock l{mutex_};
+      if (cv_.wait_for(l, interval_, [&]() { return shutdown_; })) {
+        return;
+      }
+    }
+
+    sink_(render(snapshot_func_(), format_));
+  }
+}
+
+/*static*/
+std::string StatsReporter::render(
+    const std::vector<ExecutorSnapshot>& snapshots, Format format) {
+  if (format == Format::kJson) {
+    return render_json(snapshots);
+  }
+  return render_prometheus(snapshots);
+}
+
+/*static*/
+std::string StatsReporter::render_prometheus(
+    const std::vector<ExecutorSnapshot>& snapshots) {
+  std::string s;
+
+  for (const auto& gauge : kGauges) {
+    s += std::string{"# HELP "} + gauge.name + " " + gauge.help + "\n";
+    s += std::string{"# TYPE "} + gauge.name + " " + gauge.type + "\n";
+    for (const auto& snapshot : snapshots) {
+      s += std::string{gauge.name} + "{executor=\"" +
+           escape_label(snapshot.name) + "\"} " +
+           format_number(gauge.value(snapshot)) + "\n";
+    }
+  }
+
+  for (const auto& summary : kSummaries) {
+    s += std::string{"# HELP "} + summary.name + " " + summary.help + "\n";
+    s += std::string{"# TYPE "} + summary.name + " summary\n";
+    for (const auto& snapshot : snapshots) {
+      const Histogram& h = summary.value(snapshot);
+      std::string label = "executor=\"" + escape_label(snapshot.name) + "\"";
+      for (double q : kQuantiles) {
+        s += std::string{summary.name} + "{" + label + ",quantile=\"" +
+             format_number(q) + "\"} " +
+             format_number(h.percentile(q * 100.0) / 1e6) + "\n";
+      }
+      s += std::string{summary.name} + "_sum{" + label + "} " +
+           format_number(h.sum() / 1e6) + "\n";
+      s += std::string{summary.name} + "_count{" + label + "} " +
+           std::to_string(h.count()) + "\n";
+    }
+  }
+
+  return s;
+}
+
+/*static*/
+std::string StatsReporter::render_json(
+    const std::vector<ExecutorSnapshot>& snapshots) {
+  std::string s{"{\"executors\":["};
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    const auto& snapshot = snapshots[i];
+    if (i > 0) {
+      s += ",";
+    }
+    s += "{\"name\":\"" + escape_json(snapshot.name) + "\"";
+    s += ",\"thread_weight\":" + std::to_string(snapshot.thread_weight);
+    s += ",\"worker_limit\":" + std::to_string(snapshot.worker_limit);
+    s += ",\"active\":" + std::to_string(snapshot.active_num);
+    s += ",\"active_limit\":" + std::to_string(snapshot.active_limit);
+    s += ",\"running_limit\":" + std::to_string(snapshot.running_limit);
+    s += ",\"waiting\":" + std::to_string(snapshot.waiting_num);
+    s += ",\"running\":" + std::to_string(snapshot.running_num);
+    s += ",\"throttled\":" + std::to_string(snapshot.throttled_num);
+    s += ",\"finished\":" + std::to_string(snapshot.finished_num);
+    s += ",\"expired\":" + std::to_string(snapshot.expired_num);
+    s += ",\"blocked\":" + std::to_string(snapshot.blocked_num);
+    s += ",\"ema_usage_proportion\":" +
+         format_number(snapshot.ema_usage_proportion);
+    s += ",\"ema_nivcsw_per_task\":" +
+         format_number(snapshot.ema_nivcsw_per_task);
+    s += ",\"ema_completions_per_sec\":" +
+         format_number(snapshot.ema_completions_per_sec);
+    s += ",\"ema_queue_wait_sec\":" +
+         format_number(snapshot.ema_queue_wait_sec);
+    s += ",\"queue_delay_usec\":" + histogram_json(snapshot.queue_delay_usec);
+    s += ",\"run_time_usec\":" + histogram_json(snapshot.run_time_usec);
+    s += "}";
+  }
+  s += "]}\n";
+  return s;
+}
+
+/*static*/
+StatsReporter::Sink StatsReporter::file_sink(std::string path) {
+  return [path = std::move(path)](const std::string& report) {
+    std::string tmp_path = path + ".tmp";
+    {
+      std::ofstream out{tmp_path, std::ios::trunc};
+      if (!out) {
+        LOG(WARNING) << "Could not open " << tmp_path;
+        return;
+      }
+      out << report;
+      if (!out) {
+        LOG(WARNING) << "Could not write " << tmp_path;
+        return;
+      }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      LOG(WARNING) << "Could not rename " << tmp_path << " to " << path;
+    }
+  };
+}
+
+}  // namespace theta
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+
+namespace theta {
+
+// A point-in-time copy of one executor's stats and limits.
+struct ExecutorSnapshot {
+  std::string name;
+  size_t thread_weight{0};
+  size_t worker_limit{0};
+  int active_num{0};
+  int active_limit{0};
+  size_t running_limit{0};
+
+  int waiting_num{0};
+  int running_num{0};
+  int throttled_num{0};
+  int finished_num{0};
+  int expired_num{0};
+  int blocked_num{0};
+
+  double ema_usage_proportion{0.0};
+  double ema_nivcsw_per_task{0.0};
+  double ema_completions_per_sec{0.0};
+  double ema_queue_wait_sec{0.0};
+
+  Histogram queue_delay_usec;
+  Histogram run_time_usec;
+};
+
+// Periodically takes a snapshot of every executor and hands it to a sink,
+// rendered as Prometheus text exposition or JSON. The work happens on the
+// reporter's own thread, so a slow sink never holds up the pool.
+class StatsReporter {
+ public:
+  enum class Format {
+    kPrometheus,
+    kJson,
+  };
+
+  using SnapshotFunc = std::function<std::vector<ExecutorSnapshot>()>;
+  using Sink = std::function<void(const std::string&)>;
+
+  // interval must be positive.
+  StatsReporter(SnapshotFunc snapshot_func, Sink sink, Format format,
+                std::chrono::milliseconds interval);
+  ~StatsReporter();
+
+  StatsReporter(const StatsReporter&) = delete;
+  StatsReporter& operator=(const StatsReporter&) = delete;
+
+  static std::string render(const std::vector<ExecutorSnapshot>& snapshots,
+                            Format format);
+  static std::string render_prometheus(
+      const std::vector<ExecutorSnapshot>& snapshots);
+  static std::string render_json(
+      const std::vector<ExecutorSnapshot>& snapshots);
+
+  // Replaces the file's contents with each report. The report is written to
+  // a temporary file that is renamed over path, so readers such as the
+  // node_exporter textfile collector never see a partial report.
+  static Sink file_sink(std::string path);
+
+ private:
+  const SnapshotFunc snapshot_func_;
+  const Sink sink_;
+  const Format format_;
+  const std::chrono::milliseconds interval_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool shutdown_{false};
+  std::thread thread_;
+
+  void run_loop();
+};
+
+}  // namespace theta
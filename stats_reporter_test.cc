@@ -0,0 +1,111 @@
+#include "stats_reporter.h"
+
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+namespace {
+
+std::vector<ExecutorSnapshot> make_snapshots() {
+  ExecutorSnapshot a;
+  a.name = "rpc";
+  a.thread_weight = 2;
+  a.active_limit = 4;
+  a.waiting_num = 3;
+  a.finished_num = 100;
+  for (int i = 1; i <= 100; i++) {
+    a.queue_delay_usec.record(i * 1000);
+  }
+
+  ExecutorSnapshot b;
+  b.name = "we\"ird\\";
+
+  return {a, b};
+}
+
+}  // namespace
+
+TEST(StatsReporter, prometheus) {
+  auto text = StatsReporter::render_prometheus(make_snapshots());
+
+  EXPECT_NE(text.find("# TYPE theta_executor_waiting gauge\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("theta_executor_waiting{executor=\"rpc\"} 3\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("theta_executor_finished_total{executor=\"rpc\"} 100\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("theta_executor_waiting{executor=\"we\\\"ird\\\\\"} 0\n"),
+            std::string::npos);
+
+  EXPECT_NE(text.find("# TYPE theta_executor_queue_delay_seconds summary\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("theta_executor_queue_delay_seconds{executor=\"rpc\","
+                      "quantile=\"0.5\"} 0.0"),
+            std::string::npos);
+  EXPECT_NE(text.find("theta_executor_queue_delay_seconds_sum{executor=\"rpc\"}"
+                      " 5.05\n"),
+            std::string::npos);
+  EXPECT_NE(
+      text.find(
+          "theta_executor_queue_delay_seconds_count{executor=\"rpc\"} 100\n"),
+      std::string::npos);
+}
+
+TEST(StatsReporter, json) {
+  auto text = StatsReporter::render_json(make_snapshots());
+
+  EXPECT_EQ(text.rfind("{\"executors\":[{\"name\":\"rpc\"", 0), 0);
+  EXPECT_NE(text.find("\"waiting\":3,"), std::string::npos);
+  EXPECT_NE(text.find("\"queue_delay_usec\":{\"count\":100,"),
+            std::string::npos);
+  EXPECT_NE(text.find("{\"name\":\"we\\\"ird\\\\\""), std::string::npos);
+  EXPECT_EQ(text.back(), '\n');
+}
+
+TEST(StatsReporter, file_sink) {
+  std::string path = ::testing::TempDir() + "stats_reporter_test." +
+                     std::to_string(getpid()) + ".prom";
+  auto sink = StatsReporter::file_sink(path);
+
+  sink("first\n");
+  sink("second\n");
+
+  std::ifstream in{path};
+  std::stringstream ss;
+  ss << in.rdbuf();
+  EXPECT_EQ(ss.str(), "second\n");
+  EXPECT_FALSE(std::ifstream{path + ".tmp"});
+}
+
+TEST(StatsReporter, reports_periodically) {
+  std::mutex mu;
+  std::condition_variable cv;
+  int reports = 0;
+
+  {
+    StatsReporter reporter{
+        make_snapshots,
+        [&](const std::string& report) {
+          EXPECT_NE(report.find("\"name\":\"rpc\""), std::string::npos);
+          std::lock_guard l{mu};
+          reports++;
+          cv.notify_all();
+        },
+        StatsReporter::Format::kJson, std::chrono::milliseconds{1}};
+
+    std::unique_lock l{mu};
+    EXPECT_TRUE(cv.wait_for(l, std::chrono::seconds{10},
+                            [&]() { return reports >= 3; }));
+  }
+}
+
+}  // namespace theta
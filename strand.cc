@@ -0,0 +1,108 @@
+#include "strand.h"
+
+#include <glog/logging.h>
+
+#include <thread>
+
+namespace theta {
+
+Strand::Strand(Executor executor, size_t max_batch)
+    : state_(std::make_shared<State>(executor, max_batch)) {}
+
+void Strand::post(Func func) { state_->post(std::move(func)); }
+
+Strand::State::State(Executor executor, size_t max_batch)
+    : executor_(executor),
+      max_batch_(max_batch),
+      tail_(&stub_),
+      head_(&stub_) {
+  CHECK_GT(max_batch_, 0);
+}
+
+Strand::State::~State() {
+  // Nothing is scheduled, since a drain holds a reference, so every push has
+  // finished.
+  while (Node* node = pop()) {
+    delete node;
+  }
+}
+
+void Strand::State::post(Func func) {
+  push(new Node{.func = std::move(func)});
+
+  // The drain clears scheduled_ before it checks for more nodes, so either
+  // it sees this node or this sees scheduled_ cleared.
+  if (!scheduled_.exchange(true, std::memory_order::seq_cst)) {
+    executor_.post([self = shared_from_this()]() { self->drain(); });
+  }
+}
+
+void Strand::State::push(Node* node) {
+  node->next.store(nullptr, std::memory_order::relaxed);
+  Node* prev = tail_.exchange(node, std::memory_order::seq_cst);
+  prev->next.store(node, std::memory_order::release);
+}
+
+Strand::Node* Strand::State::pop() {
+  Node* head = head_;
+  Node* next = head->next.load(std::memory_order::acquire);
+  if (head == &stub_) {
+    if (!next) {
+      return nullptr;
+    }
+    head_ = next;
+    head = next;
+    next = next->next.load(std::memory_order::acquire);
+  }
+
+  if (next) {
+    head_ = next;
+    return head;
+  }
+
+  if (tail_.load(std::memory_order::acquire) != head) {
+    return nullptr;
+  }
+
+  // head is the last node. Put the stub behind it so that head can be
+  // handed out without leaving the list empty.
+  push(&stub_);
+  next = head->next.load(std::memory_order::acquire);
+  if (next) {
+    head_ = next;
+    return head;
+  }
+  return nullptr;
+}
+
+bool Strand::State::empty() const {
+  return head_ == &stub_ &&
+         tail_.load(std::memory_order::seq_cst) == &stub_;
+}
+
+void Strand::State::drain() {
+  size_t ran = 0;
+  while (ran < max_batch_) {
+    if (Node* node = pop()) {
+      node->func();
+      delete node;
+      ran++;
+      continue;
+    }
+
+    if (!empty()) {
+      // A producer swapped itself into the tail but has not linked it yet.
+      std::this_thread::yield();
+      continue;
+    }
+
+    scheduled_.store(false, std::memory_order::seq_cst);
+    if (empty() || scheduled_.exchange(true, std::memory_order::seq_cst)) {
+      return;
+    }
+  }
+
+  executor_.post([self = shared_from_this()]() { self->drain(); });
+}
+
+}  // namespace theta
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "executor.h"
+
+namespace theta {
+
+// Runs the funcs posted to it one at a time, in the order that they were
+// posted, on top of any executor. Unlike an executor with a worker_limit of
+// 1, a strand is a single small allocation, so tens of thousands of them are
+// cheap.
+//
+// Posted funcs go onto an intrusive MPSC list. The post that finds the
+// strand unscheduled posts a drain to the underlying executor, and the drain
+// runs up to max_batch funcs before it re-posts itself, so one handoff to a
+// worker is paid per batch rather than per func. The re-post lets other
+// work on the executor run between batches.
+//
+// Strand is a handle: copies share the same order. Funcs that are still
+// queued when the last copy is destroyed still run.
+class Strand {
+ public:
+  using Func = Executor::Func;
+
+  static constexpr size_t kDefaultMaxBatch = 32;
+
+  explicit Strand(Executor executor, size_t max_batch = kDefaultMaxBatch);
+
+  void post(Func func);
+
+ private:
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    Func func;
+  };
+
+  class State : public std::enable_shared_from_this<State> {
+   public:
+    State(Executor executor, size_t max_batch);
+    ~State();
+
+    void post(Func func);
+
+   private:
+    Executor executor_;
+    const size_t max_batch_;
+
+    // Set while a drain is posted or running. Only the thread that sets it
+    // may run funcs, which is what keeps them serial.
+    std::atomic<bool> scheduled_{false};
+
+    // Vyukov's MPSC queue. Producers swap themselves into tail_ and then
+    // link the previous tail to themselves, so a producer that is between
+    // the two steps briefly hides the nodes behind it.
+    alignas(hardware_destructive_interference_size) std::atomic<Node*> tail_;
+    alignas(hardware_destructive_interference_size) Node* head_;
+    Node stub_;
+
+    void push(Node* node);
+    // Returns nullptr when the queue is empty or a push is half done.
+    Node* pop();
+    bool empty() const;
+
+    void drain();
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace theta
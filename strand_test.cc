@@ -0,0 +1,114 @@
+#include "strand.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <latch>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+namespace {
+
+Executor create_executor() {
+  auto num_threads = std::thread::hardware_concurrency();
+  return ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(num_threads)
+          .set_worker_limit(Executor::Opts::kNoWorkerLimit));
+}
+
+}  // namespace
+
+TEST(Strand, runs_serially_in_post_order) {
+  static constexpr int kPosters = 8;
+  static constexpr int kPerPoster = 10000;
+
+  Executor executor = create_executor();
+  Strand strand{executor, /*max_batch=*/4};
+
+  // Written only by the strand, so a plain vector and int are enough if the
+  // funcs really run one at a time.
+  std::vector<int> last(kPosters, -1);
+  int in_flight = 0;
+  std::atomic<bool> ordered{true};
+  std::latch done{kPosters * kPerPoster};
+
+  std::vector<std::thread> posters;
+  for (int p = 0; p < kPosters; p++) {
+    posters.emplace_back([&, p]() {
+      for (int i = 0; i < kPerPoster; i++) {
+        strand.post([&, p, i]() {
+          if (++in_flight != 1 || last[p] != i - 1) {
+            ordered.store(false);
+          }
+          last[p] = i;
+          in_flight--;
+          done.count_down();
+        });
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+  done.wait();
+
+  EXPECT_TRUE(ordered.load());
+  for (int p = 0; p < kPosters; p++) {
+    EXPECT_EQ(last[p], kPerPoster - 1);
+  }
+}
+
+TEST(Strand, many_strands_run_in_parallel) {
+  static constexpr int kStrands = 10000;
+  static constexpr int kPerStrand = 10;
+
+  Executor executor = create_executor();
+  std::vector<Strand> strands;
+  strands.reserve(kStrands);
+  for (int s = 0; s < kStrands; s++) {
+    strands.emplace_back(executor);
+  }
+
+  std::vector<int> counts(kStrands, 0);
+  std::atomic<bool> ordered{true};
+  std::latch done{kStrands * kPerStrand};
+  for (int i = 0; i < kPerStrand; i++) {
+    for (int s = 0; s < kStrands; s++) {
+      strands[s].post([&, s, i]() {
+        if (counts[s]++ != i) {
+          ordered.store(false);
+        }
+        done.count_down();
+      });
+    }
+  }
+  done.wait();
+
+  EXPECT_TRUE(ordered.load());
+}
+
+TEST(Strand, queued_funcs_outlive_the_strand) {
+  Executor executor = create_executor();
+
+  std::latch release{1};
+  std::latch done{2};
+  {
+    Strand strand{executor};
+    strand.post([&]() {
+      release.wait();
+      done.count_down();
+    });
+    strand.post([&]() { done.count_down(); });
+  }
+  release.count_down();
+  done.wait();
+}
+
+}  // namespace theta
@@ -1,9 +1,31 @@
 #include "task.h"
 
+#include <algorithm>
+
 #include "executor.h"
+#include "probes.h"
+#include "topology.h"
+#include "trace.h"
 
 namespace theta {
 
+namespace {
+
+double tv_sec(const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+uint64_t usec_between(const timeval& begin, const timeval& end) {
+  int64_t usec = (end.tv_sec - begin.tv_sec) * 1000000 +
+                 (end.tv_usec - begin.tv_usec);
+  return std::max<int64_t>(0, usec);
+}
+
+thread_local Task* current_task{nullptr};
+
+}  // namespace
+
+/*static*/
+Task* Task::current() { return current_task; }
+
 /*static*/
 void Task::run(std::unique_ptr<Task> task) {
   ExecutorImpl* executor = task->opts().executor();
@@ -13,16 +35,45 @@ void Task::run(std::unique_ptr<Task> task) {
   getrusage(RUSAGE_THREAD, &task->begin_ru_);
   ExecutorImpl::get_tv(&task->begin_tv_);
 
-  task->opts().func()();
+  current_task = task.get();
+  THETA_PROBE2(task_start, executor, task.get());
+  auto deadline = task->opts().deadline();
+  if (deadline == Clock::time_point::max() || Clock::now() <= deadline) {
+    task->opts().func()();
+  } else {
+    executor->stats()->expired_delta(1);
+    if (task->opts().expire_func()) {
+      task->opts().expire_func()();
+    }
+  }
+  current_task = nullptr;
 
   getrusage(RUSAGE_THREAD, &task->end_ru_);
   ExecutorImpl::get_tv(&task->end_tv_);
 
-  executor->stats()->update_ema(&task->begin_ru_, &task->begin_tv_,
-                                &task->end_ru_, &task->end_tv_);
-
-  executor->unreserve_active();
-  executor->throttle_list_.remove(task.release());
+  task->worker()->record_usage(
+      executor,
+      Usage{.wall_sec = tv_sec(task->end_tv_) - tv_sec(task->begin_tv_) -
+                        task->blocked_sec_,
+            .utime_sec = tv_sec(task->end_ru_.ru_utime) -
+                         tv_sec(task->begin_ru_.ru_utime),
+            .queue_wait_sec =
+                tv_sec(task->begin_tv_) - tv_sec(task->queued_tv_),
+            .nivcsw = task->end_ru_.ru_nivcsw - task->begin_ru_.ru_nivcsw,
+            .tasks = 1});
+
+  int64_t wall_usec = usec_between(task->begin_tv_, task->end_tv_);
+  THETA_PROBE3(task_finish, executor, task.get(), wall_usec);
+  RunQueue::charge(executor->lanes_[task->queue_index_].get(), task.get(),
+                   wall_usec);
+
+  if (task->holds_active_) {
+    executor->unreserve_active();
+  }
+  // A task that ScopedBlocking throttled is unthrottled by its removal. Doing
+  // that now keeps the stats from counting it as throttled after it is done.
+  bool flush = task->throttle_pinned_;
+  executor->throttle_list_.remove(task.release(), flush);
 }
 
 Task::Task(Opts opts)
@@ -42,7 +93,17 @@ Task::State Task::set_state(State state) {
   auto* executor = opts().executor();
   auto* stats = executor->stats();
 
+  // Leaving a queued state is when a worker picks the task up.
+  auto record_queue_delay = [&]() {
+    timeval now;
+    ExecutorImpl::get_tv(&now);
+    stats->record_queue_delay_usec(usec_between(queued_tv_, now));
+  };
+
   if (old == State::kCreated) {
+    ExecutorImpl::get_tv(&queued_tv_);
+    post_node_ = get_local_node();
+
     if (state == State::kQueuedExecutor) {
       stats->waiting_delta(1);
     } else if (state == State::kQueuedThreadpool) {
@@ -54,10 +115,12 @@ Task::State Task::set_state(State state) {
   } else if (old == State::kQueuedExecutor) {
     if (state == State::kQueuedThreadpool) {
     } else if (state == State::kRunning) {
+      record_queue_delay();
       stats->waiting_delta(-1);
       stats->running_delta(1);
       worker()->set_nice_priority(opts().nice_priority());
     } else if (state == State::kThrottled) {
+      record_queue_delay();
       stats->waiting_delta(-1);
       stats->throttled_delta(1);
       worker()->set_nice_priority(NicePriority::kThrottled);
@@ -67,10 +130,12 @@ Task::State Task::set_state(State state) {
     }
   } else if (old == State::kQueuedThreadpool) {
     if (state == State::kRunning) {
+      record_queue_delay();
       stats->waiting_delta(-1);
       stats->running_delta(1);
       worker()->set_nice_priority(opts().nice_priority());
     } else if (state == State::kThrottled) {
+      record_queue_delay();
       stats->waiting_delta(-1);
       stats->throttled_delta(1);
       worker()->set_nice_priority(NicePriority::kThrottled);
@@ -89,6 +154,7 @@ Task::State Task::set_state(State state) {
       stats->throttled_delta(1);
       worker()->set_nice_priority(NicePriority::kThrottled);
     } else if (state == State::kFinished) {
+      stats->record_run_time_usec(usec_between(begin_tv_, end_tv_));
       stats->running_delta(-1);
       stats->finished_delta(1);
       worker()->set_nice_priority(NicePriority::kNormal);
@@ -102,6 +168,7 @@ Task::State Task::set_state(State state) {
       stats->running_delta(1);
       worker()->set_nice_priority(opts().nice_priority());
     } else if (state == State::kFinished) {
+      stats->record_run_time_usec(usec_between(begin_tv_, end_tv_));
       stats->throttled_delta(-1);
       stats->finished_delta(1);
       worker()->set_nice_priority(NicePriority::kNormal);
@@ -115,6 +182,13 @@ Task::State Task::set_state(State state) {
   }
 
   state_.store(state, std::memory_order::release);
+  if (state == State::kThrottled) {
+    THETA_PROBE2(throttle, executor, this);
+  } else if (old == State::kThrottled && state == State::kRunning) {
+    THETA_PROBE2(unthrottle, executor, this);
+  }
+  trace_task_state(this, executor, static_cast<int>(old),
+                   static_cast<int>(state));
   return state;
 }
 
@@ -147,18 +221,29 @@ void ThrottleList::append(Task* task) {
   }
 }
 
-void ThrottleList::remove(Task* task) {
+void ThrottleList::remove(Task* task, bool flush) {
   Modification mod{Modification::Op::kRemove, task};
   size_t num_items;
   while (!modification_queue_.push_back(mod, &num_items)) {
     flush_modifications(/*wait_for_mtx=*/true);
   }
 
-  if (num_items > modification_queue_.capacity() / 2) {
+  if (flush) {
+    flush_modifications(/*wait_for_mtx=*/true);
+  } else if (num_items > modification_queue_.capacity() / 2) {
     flush_modifications();
   }
 }
 
+void ThrottleList::throttle(Task* task) {
+  Modification mod{Modification::Op::kThrottle, task};
+  size_t num_items;
+  while (!modification_queue_.push_back(mod, &num_items)) {
+    flush_modifications(/*wait_for_mtx=*/true);
+  }
+  flush_modifications(/*wait_for_mtx=*/true);
+}
+
 uint32_t ThrottleList::running_limit(std::memory_order mem_order) const {
   Count count{count_, mem_order};
   return count.running_limit();
@@ -198,8 +283,7 @@ void ThrottleList::flush_modifications(bool wait_for_mtx) {
         break;
       }
 
-      auto total = count_.total_delta(1);
-
+      uint32_t total;
       Task* task{mod.task()};
       switch (mod.op()) {
         case Modification::Op::kAppend:
@@ -216,33 +300,28 @@ void ThrottleList::flush_modifications(bool wait_for_mtx) {
             throttle_head_ = task;
             task->set_state(Task::State::kThrottled);
           } else {
-            task->set_state(Task::State::kRunning);
+            // Task::run already set the task running.
+            if (task->state() != Task::State::kRunning) {
+              task->set_state(Task::State::kRunning);
+            }
             count_.running_delta(1);
           }
 
           DCHECK(task->next_);
           DCHECK(task->prev_);
           break;
+        case Modification::Op::kThrottle:
+          if (task->next_) {
+            unlink(lock, task);
+          }
+          if (task->state() != Task::State::kThrottled) {
+            task->set_state(Task::State::kThrottled);
+          }
+          break;
         default:  // Modification::Op::kRemove:
-          total = count_.total_delta(-1);
-
-          task->next_->prev_ = task->prev_;
-          task->prev_->next_ = task->next_;
-
-          auto state = task->state();
-          if (state == Task::State::kRunning) {
-            DCHECK(throttle_head_ != task);
-
-            if (throttle_head_ != tail_) {
-              throttle_head_->set_state(Task::State::kRunning);
-              throttle_head_ = throttle_head_->next_;
-            } else {
-              count_.running_delta(-1);
-            }
-          } else if (task == throttle_head_) {
-            throttle_head_ = task->next_;
+          if (task->next_) {
+            unlink(lock, task);
           }
-
           task->set_state(Task::State::kFinished);
           to_delete.push_back(task);
 
@@ -258,6 +337,29 @@ void ThrottleList::flush_modifications(bool wait_for_mtx) {
   }
 }
 
+void ThrottleList::unlink(std::unique_lock<std::mutex>&, Task* task) {
+  count_.total_delta(-1);
+
+  task->next_->prev_ = task->prev_;
+  task->prev_->next_ = task->next_;
+
+  if (task->state() == Task::State::kRunning) {
+    DCHECK(throttle_head_ != task);
+
+    if (throttle_head_ != tail_) {
+      throttle_head_->set_state(Task::State::kRunning);
+      throttle_head_ = throttle_head_->next_;
+    } else {
+      count_.running_delta(-1);
+    }
+  } else if (task == throttle_head_) {
+    throttle_head_ = task->next_;
+  }
+
+  task->prev_ = nullptr;
+  task->next_ = nullptr;
+}
+
 void ThrottleList::adjust_throttle_head(std::unique_lock<std::mutex>&) {
   Count count{count_, /*mem_order=*/std::memory_order::acquire};
   uint32_t running = count.running();
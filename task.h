@@ -10,6 +10,7 @@ static_assert(false);
 #include <sys/time.h>
 
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <memory>
@@ -24,6 +25,7 @@ static_assert(false);
 namespace theta {
 
 class ExecutorImpl;
+class RunQueue;
 class Worker;
 
 enum class NicePriority : uint32_t {
@@ -84,12 +86,17 @@ class ThrottleList;
 // running/prioritized state.
 //
 class Task {
+  friend class EDFExecutorImpl;
   friend class ExecutorImpl;
+  friend class LIFOExecutorImpl;
+  friend class RunQueue;
+  friend class ScopedBlocking;
   friend class Worker;
   friend class ThrottleList;
 
  public:
   using Func = std::function<void()>;
+  using Clock = std::chrono::high_resolution_clock;
 
   class Opts {
    public:
@@ -111,8 +118,27 @@ class Task {
       return *this;
     }
 
+    // Runs instead of func if the deadline passed before a worker started
+    // the task.
+    Func expire_func() const { return expire_func_; }
+    Opts& set_expire_func(Func val) {
+      expire_func_ = val;
+      return *this;
+    }
+
+    // Task::run checks the deadline when the task starts, since a task can
+    // still wait on the run queue or in a batch after it was admitted.
+    // Tasks without a deadline never expire.
+    Clock::time_point deadline() const { return deadline_; }
+    Opts& set_deadline(Clock::time_point val) {
+      deadline_ = val;
+      return *this;
+    }
+
    private:
     Func func_{nullptr};
+    Func expire_func_{nullptr};
+    Clock::time_point deadline_{Clock::time_point::max()};
     ExecutorImpl* executor_{nullptr};
     NicePriority nice_priority_{NicePriority::kNormal};
   };
@@ -130,6 +156,10 @@ class Task {
 
   static void run(std::unique_ptr<Task> task);
 
+  // The task that the calling thread is running, or nullptr if the caller is
+  // not running a task.
+  static Task* current();
+
   Task(Opts opts);
 
   const Opts& opts() const { return opts_; }
@@ -148,14 +178,40 @@ class Task {
   const Opts opts_;
   rusage begin_ru_;
   rusage end_ru_;
+  timeval queued_tv_;
   timeval begin_tv_;
   timeval end_tv_;
 
   std::atomic<State> state_{State::kCreated};
   std::atomic<Worker*> worker_{nullptr};
 
+  // The NUMA node that the task was posted from, and the index of the
+  // pool's run queue, and of its executor's lane, that it was admitted to.
+  int post_node_{0};
+  size_t queue_index_{0};
+
+  // What the RunQueue debited the executor's lane when it dispatched this
+  // task. Zero if the task never went through the RunQueue.
+  int64_t dispatch_estimate_usec_{0};
+
+  // Whether the task counts against its executor's active limit. This is
+  // false while the task is inside of a ScopedBlocking region, and stays false
+  // if no slot was free when the region ended.
+  bool holds_active_{false};
+  // Time spent inside of ScopedBlocking regions. It is left out of the usage
+  // that is reported to the scaler, since the pool already compensated for it.
+  double blocked_sec_{0.0};
+  // Set when a ScopedBlocking region ended without a free active slot. The
+  // task then stays throttled until it finishes.
+  bool throttle_pinned_{false};
+
+  // Links the task into an executor's intrusive list of posted tasks, e.g.
+  // the LIFOExecutorImpl stack. Unused once the executor hands it out.
+  Task* pending_next_{nullptr};
+
   ThrottleList* throttle_list_{nullptr};
-  // These variables are only read while holding throttle_list_->mtx_.
+  // These variables are only read while holding throttle_list_->mtx_. Both
+  // are nullptr once ThrottleList::throttle took the task off the list.
   Task* prev_{nullptr};
   Task* next_{nullptr};
 };
@@ -237,7 +293,13 @@ class ThrottleList {
   ThrottleList(size_t modification_queue_size);
 
   void append(Task* task);
-  void remove(Task* task);
+  // Applies the removal right away when flush is set, instead of with the
+  // next batch of modifications.
+  void remove(Task* task, bool flush = false);
+  // Throttles a running task until it is removed, whatever the running
+  // limit, and applies it right away. The task leaves the list, so that it
+  // is never promoted and does not hold back the tasks behind it.
+  void throttle(Task* task);
   uint32_t running_limit(
       std::memory_order mem_order = std::memory_order::relaxed) const;
   void set_running_limit(size_t running_limit);
@@ -252,6 +314,7 @@ class ThrottleList {
     enum class Op : uintptr_t {
       kAppend = 1,
       kRemove = 2,
+      kThrottle = 3,
     };
 
     Modification() : data_(0) {}
@@ -366,6 +429,9 @@ class ThrottleList {
   std::mutex mtx_;
 
   void flush_modifications(bool wait_for_mtx = false);
+  // Takes the task off the list, and lets the first throttled task run in
+  // its place if it was running.
+  void unlink(std::unique_lock<std::mutex>&, Task* task);
   void adjust_throttle_head(std::unique_lock<std::mutex>&);
 };
 
@@ -1,19 +1,109 @@
 #include "threadpool.h"
 
+#include <glog/logging.h>
+#include <sched.h>
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <thread>
+#include <unordered_map>
 
 using namespace std::chrono_literals;
 
 namespace theta {
 
+namespace {
+
+// Cgroup limits can change underneath a running process, e.g. when a
+// Kubernetes pod is resized, but reading them takes a handful of syscalls.
+constexpr auto kCpuCapacityRefreshInterval = 5s;
+
+// Returns false if the mask cannot be read, in which case every CPU may be
+// used as far as the pool can tell.
+bool allowed_cpus(cpu_set_t* allowed) {
+  CPU_ZERO(allowed);
+  return sched_getaffinity(0, sizeof(*allowed), allowed) == 0;
+}
+
+// The affinities of each run queue's workers, given the node of each queue.
+// With more than one queue, workers never leave their queue's node.
+std::vector<std::vector<Worker::Affinity>> worker_affinities(
+    const ThrottlingThreadpool::ConfigureOpts& opts,
+    const CpuTopology& topology, const std::vector<int>& queue_nodes) {
+  std::vector<std::vector<Worker::Affinity>> affinities(queue_nodes.size());
+  cpu_set_t allowed;
+  if (!allowed_cpus(&allowed)) {
+    return affinities;
+  }
+  bool per_node = queue_nodes.size() > 1;
+
+  std::vector<std::vector<int>> groups;
+  switch (opts.worker_pinning()) {
+    case WorkerPinning::kPerCore:
+      groups = topology.cores();
+      break;
+    case WorkerPinning::kPerLlc:
+      groups = topology.llcs();
+      break;
+    default:
+      if (per_node) {
+        for (const auto& node : topology.nodes()) {
+          groups.push_back(node.cpus);
+        }
+        break;
+      }
+      if (!opts.smt_aware_throttling()) {
+        return affinities;
+      }
+      groups.emplace_back();
+      for (const auto& cpu : topology.cpus()) {
+        groups.back().push_back(cpu.id);
+      }
+      break;
+  }
+
+  for (const auto& group : groups) {
+    Worker::Affinity affinity;
+    for (int cpu : group) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        affinity.cpus.push_back(cpu);
+      }
+    }
+    if (affinity.cpus.empty()) {
+      continue;
+    }
+    auto it = std::find(queue_nodes.begin(), queue_nodes.end(),
+                        topology.node_of(affinity.cpus.front()));
+    size_t queue = it != queue_nodes.end() ? it - queue_nodes.begin() : 0;
+    if (per_node) {
+      affinity.node = queue_nodes[queue];
+    }
+    if (opts.smt_aware_throttling()) {
+      affinity.throttled_cpus = topology.one_per_core(affinity.cpus);
+      if (affinity.throttled_cpus == affinity.cpus) {
+        // No core has two siblings here.
+        affinity.throttled_cpus.clear();
+      }
+    }
+    affinities[queue].push_back(std::move(affinity));
+  }
+  return affinities;
+}
+
+}  // namespace
+
 /*static*/
 ThrottlingThreadpool::ConfigureOpts
 ThrottlingThreadpool::ConfigureOpts::defaultOpts() {
+  size_t cpus = std::ceil(CpuCapacity{}.detect());
   return ConfigureOpts{}
-      .set_nice_cores(std::thread::hardware_concurrency() / 8)
-      .set_thread_limit(8 * std::thread::hardware_concurrency())
-      .set_throttle_interval(100ms);
+      .set_nice_cores(cpus / 8)
+      .set_thread_limit(8 * cpus)
+      .set_core_threads(1)
+      .set_idle_timeout(10s)
+      .set_throttle_interval(100ms)
+      .set_stats_interval(10s);
 }
 
 /*static*/
@@ -24,19 +114,71 @@ ThrottlingThreadpool& ThrottlingThreadpool::getInstance() {
 
 void ThrottlingThreadpool::configure(
     const ThrottlingThreadpool::ConfigureOpts& opts) {
-  std::unique_lock l{shared_mutex_};
-  opts_ = opts;
+  CHECK(!opts.stats_sink() || opts.stats_interval().count() > 0)
+      << "stats_interval must be positive when a stats sink is set";
+  CHECK_GT(opts.throttle_interval().count(), 0)
+      << "A zero throttle_interval would keep the scaler spinning";
+
+  // Extra workers retire after their current task once they are over the
+  // new thread_limit, and a raised limit is used by the next spawn.
+  opts_.publish(opts);
+  for (auto& run_queue : run_queues_) {
+    run_queue->set_idle_spin(opts.idle_spin(), opts.idle_spinners());
+  }
+
+  std::unique_ptr<StatsReporter> reporter;
+  if (opts.stats_sink()) {
+    reporter = std::make_unique<StatsReporter>(
+        [this]() { return stats_snapshot(); }, opts.stats_sink(),
+        opts.stats_format(), opts.stats_interval());
+  }
+  {
+    std::lock_guard l{reporter_mutex_};
+    reporter_.swap(reporter);
+  }
+  // The old reporter, if any, is joined here.
+  reporter.reset();
+
+  auto affinities = worker_affinities(opts, topology(), queue_nodes_);
+
+  std::unique_lock l{workers_mutex_};
+  worker_affinities_ = std::move(affinities);
+  next_affinity_.assign(run_queues_.size(), 0);
+  // Core threads are spread evenly over the nodes.
+  while (true) {
+    size_t live = live_workers_.load(std::memory_order::acquire);
+    if (live >= std::min(opts.core_threads(), opts.thread_limit())) {
+      break;
+    }
+    spawn_worker(l, live % run_queues_.size());
+  }
+  unlock_workers(l);
 }
 
 Executor ThrottlingThreadpool::create(Executor::Opts opts) {
-  opts.set_run_queue(&run_queue_);
+  std::vector<RunQueue*> run_queues;
+  for (auto& run_queue : run_queues_) {
+    run_queues.push_back(run_queue.get());
+  }
+  opts.set_run_queues(std::move(run_queues), queue_of_node_);
+  opts.set_timers(timers_.get());
   if (opts.worker_limit() == ExecutorOpts::kNoWorkerLimit) {
-    opts.set_worker_limit(opts_.thread_limit());
+    opts.set_worker_limit(opts_->thread_limit());
   }
   std::unique_ptr<ExecutorImpl> impl;
   if (opts.priority_policy() == PriorityPolicy::FIFO) {
     impl = std::unique_ptr<FIFOExecutorImpl>(
         new FIFOExecutorImpl(std::move(opts)));
+  } else if (opts.priority_policy() == PriorityPolicy::LIFO) {
+    impl = std::unique_ptr<LIFOExecutorImpl>(
+        new LIFOExecutorImpl(std::move(opts)));
+  } else if (opts.priority_policy() ==
+             PriorityPolicy::EarliestDeadlineFirst) {
+    impl = std::unique_ptr<EDFExecutorImpl>(
+        new EDFExecutorImpl(std::move(opts)));
+  } else if (opts.priority_policy() == PriorityPolicy::ExplicitPriority) {
+    impl = std::unique_ptr<PriorityExecutorImpl>(
+        new PriorityExecutorImpl(std::move(opts)));
   } else {
     throw NotImplemented();
   }
@@ -53,19 +195,257 @@ Executor ThrottlingThreadpool::create(Executor::Opts opts) {
 }
 
 ThrottlingThreadpool::~ThrottlingThreadpool() {
+  {
+    std::lock_guard l{reporter_mutex_};
+    reporter_.reset();
+  }
+
+  timers_.reset();
+
+  {
+    std::lock_guard l{scaler_mutex_};
+    scaler_shutdown_ = true;
+  }
+  scaler_cv_.notify_all();
+  scaler_thread_.join();
+
+  // Nothing may start a worker from here on.
+  opts_.update([](ConfigureOpts& opts) { opts.set_thread_limit(0); });
+
+  std::lock_guard l{workers_mutex_};
   for (auto& worker : workers_) {
     worker->shutdown();
   }
 
-  run_queue_.shutdown();
+  for (auto& run_queue : run_queues_) {
+    run_queue->shutdown();
+  }
+
+  // Join the workers before the executors that their tasks point into are
+  // destroyed.
+  workers_.clear();
 }
 
 ThrottlingThreadpool::ThrottlingThreadpool() {
-  opts_ = ConfigureOpts::defaultOpts();
+  cpu_capacity_.store(CpuCapacity{}.detect(), std::memory_order::release);
+  init_run_queues();
+  timers_ = std::make_unique<TimerService>(
+      [](ExecutorImpl* executor, std::vector<Func> funcs) {
+        executor->post_batch(std::move(funcs));
+      });
+
+  configure(ConfigureOpts::defaultOpts());
+
+  scaler_thread_ = std::thread(&ThrottlingThreadpool::scaler_loop, this);
+}
+
+std::vector<ExecutorSnapshot> ThrottlingThreadpool::stats_snapshot() {
+  std::vector<ExecutorSnapshot> snapshots;
+
+  std::shared_lock l{shared_mutex_};
+  snapshots.reserve(executors_.size());
+  for (size_t i = 0; i < executors_.size(); i++) {
+    snapshots.push_back(executors_[i]->snapshot());
+    if (snapshots.back().name.empty()) {
+      snapshots.back().name = "executor" + std::to_string(i);
+    }
+  }
+  return snapshots;
+}
+
+std::string ThrottlingThreadpool::render_stats(StatsReporter::Format format) {
+  return StatsReporter::render(stats_snapshot(), format);
+}
+
+void ThrottlingThreadpool::init_run_queues() {
+  cpu_set_t allowed;
+  bool restricted = allowed_cpus(&allowed);
+  for (const auto& node : topology().nodes()) {
+    if (restricted && std::none_of(node.cpus.begin(), node.cpus.end(),
+                                   [&](int cpu) {
+                                     return CPU_ISSET(cpu, &allowed);
+                                   })) {
+      continue;
+    }
+    queue_nodes_.push_back(node.id);
+    run_queues_.push_back(make_node_local<RunQueue>(node.id));
+  }
+  if (run_queues_.empty()) {
+    int node = topology().nodes().front().id;
+    queue_nodes_.push_back(node);
+    run_queues_.push_back(make_node_local<RunQueue>(node));
+  }
+
+  queue_of_node_.assign(
+      *std::max_element(queue_nodes_.begin(), queue_nodes_.end()) + 1, 0);
+  for (size_t i = 0; i < run_queues_.size(); i++) {
+    queue_of_node_[queue_nodes_[i]] = i;
+    run_queues_[i]->set_starved_callback([this]() { maybe_spawn_worker(); });
+    run_queues_[i]->set_steal_callback([this, i]() { return steal_task(i); });
+  }
+}
+
+void ThrottlingThreadpool::maybe_spawn_worker() {
+  // Pushes never wait for workers_mutex_. Whichever thread holds it serves
+  // the flag before it lets go.
+  spawn_pending_.store(true, std::memory_order::seq_cst);
+  std::atomic_thread_fence(std::memory_order::seq_cst);
+  std::unique_lock l{workers_mutex_, std::try_to_lock};
+  if (l.owns_lock()) {
+    unlock_workers(l);
+  }
+}
+
+void ThrottlingThreadpool::unlock_workers(std::unique_lock<std::mutex>& l) {
+  do {
+    if (spawn_pending_.exchange(false, std::memory_order::acq_rel)) {
+      for (size_t i = 0; i < run_queues_.size(); i++) {
+        if (run_queues_[i]->size() > 0 &&
+            run_queues_[i]->idle_workers() == 0) {
+          serve_starved_queue(l, i);
+        }
+      }
+    }
+    l.unlock();
+    // A push that found the mutex held after the exchange above left the
+    // flag set, and counts on this thread to see it.
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+  } while (spawn_pending_.load(std::memory_order::relaxed) && l.try_lock());
+}
+
+void ThrottlingThreadpool::serve_starved_queue(
+    const std::unique_lock<std::mutex>& l, size_t queue) {
+  if (live_workers_.load(std::memory_order::acquire) < opts_->thread_limit()) {
+    spawn_worker(l, queue);
+    return;
+  }
+
+  // Out of workers, so an idle worker of another node runs the task.
+  for (size_t i = 1; i < run_queues_.size(); i++) {
+    auto& other = *run_queues_[(queue + i) % run_queues_.size()];
+    if (other.idle_workers() > 0) {
+      other.request_steal();
+      return;
+    }
+  }
+}
+
+void ThrottlingThreadpool::spawn_worker(const std::unique_lock<std::mutex>&,
+                                        size_t queue) {
+  Worker::Affinity affinity;
+  const auto& affinities = worker_affinities_[queue];
+  if (!affinities.empty()) {
+    affinity = affinities[next_affinity_[queue]++ % affinities.size()];
+  }
+
+  live_workers_.fetch_add(1, std::memory_order::acq_rel);
+  workers_.push_back(std::make_unique<Worker>(
+      run_queues_[queue].get(), opts_->idle_timeout(),
+      [this](bool idle) { return retire_worker(idle); }, std::move(affinity)));
+}
+
+std::unique_ptr<Task> ThrottlingThreadpool::steal_task(size_t thief) {
+  for (size_t i = 1; i < run_queues_.size(); i++) {
+    auto& victim = *run_queues_[(thief + i) % run_queues_.size()];
+    if (victim.size() == 0) {
+      continue;
+    }
+    if (auto task = victim.steal()) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+bool ThrottlingThreadpool::retire_worker(bool idle) {
+  size_t live = live_workers_.load(std::memory_order::acquire);
+  while (true) {
+    auto opts = opts_.get();
+    size_t keep = idle ? std::min(opts->core_threads(), opts->thread_limit())
+                       : opts->thread_limit();
+    if (live <= keep) {
+      return false;
+    }
+    if (live_workers_.compare_exchange_weak(live, live - 1,
+                                            std::memory_order::acq_rel,
+                                            std::memory_order::acquire)) {
+      return true;
+    }
+  }
+}
+
+void ThrottlingThreadpool::scaler_loop() {
+  auto last = std::chrono::steady_clock::now();
+  auto last_capacity_refresh = last;
+  while (true) {
+    std::chrono::milliseconds interval = opts_->throttle_interval();
+
+    {
+      std::unique_lock l{scaler_mutex_};
+      if (scaler_cv_.wait_for(l, interval,
+                              [&]() { return scaler_shutdown_; })) {
+        return;
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_capacity_refresh >= kCpuCapacityRefreshInterval) {
+      cpu_capacity_.store(CpuCapacity{}.detect(), std::memory_order::release);
+      last_capacity_refresh = now;
+    }
+
+    scale(std::chrono::duration<double>(now - last).count());
+    last = now;
+  }
+}
+
+void ThrottlingThreadpool::scale(double interval_sec) {
+  std::unordered_map<ExecutorImpl*, Usage> usage;
+
+  {
+    std::unique_lock l{workers_mutex_};
+    for (auto& worker : workers_) {
+      worker->drain_usage(&usage);
+    }
+    // Retired workers have already returned from their thread, so this only
+    // joins them.
+    std::erase_if(workers_, [](const std::unique_ptr<Worker>& worker) {
+      return worker->retired();
+    });
+    // Backs up the starved callbacks, in case a task was still left without
+    // a worker, e.g. by a worker that was retiring as it was pushed.
+    spawn_pending_.store(true, std::memory_order::relaxed);
+    unlock_workers(l);
+  }
+
+  std::shared_lock l{shared_mutex_};
+
+  std::vector<double> demands;
+  std::vector<double> weights;
+  demands.reserve(executors_.size());
+  weights.reserve(executors_.size());
+  for (auto& executor : executors_) {
+    // Executors that finished nothing still fold, so that their completion
+    // rate decays.
+    auto it = usage.find(executor.get());
+    executor->stats()->fold_usage(
+        it != usage.end() ? it->second : Usage{}, interval_sec,
+        std::chrono::duration<double>(executor->opts()->ema_tau()).count());
+    demands.push_back(executor->cpu_demand());
+    weights.push_back(executor->opts()->thread_weight());
+  }
 
-  workers_.reserve(opts_.thread_limit());
-  for (size_t i = 0; i < opts_.thread_limit(); i++) {
-    workers_.push_back(std::make_unique<Worker>(&run_queue_));
+  // Under contention, each executor's active limit converges on its weighted
+  // share of the CPUs. An idle executor may use all of the CPUs until the
+  // next pass so that its first posts are not held back.
+  auto shares = weighted_fair_shares(cpu_capacity(), demands, weights);
+  for (size_t i = 0; i < executors_.size(); i++) {
+    auto& executor = executors_[i];
+    executor->refresh_limits(demands[i] > 0.0 ? shares[i] : cpu_capacity(),
+                             interval_sec);
+    // A raised limit should not have to wait for the next post or completion
+    // before it admits more tasks. An idle worker does the admitting.
+    executor->maybe_mark_ready();
   }
 }
 }  // namespace theta
@@ -4,24 +4,51 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
 #include <limits>
 #include <shared_mutex>
 #include <thread>
 
+#include "blocking.h"
+#include "cpu_capacity.h"
+#include "edf_executor.h"
 #include "executor.h"
+#include "fair_share.h"
 #include "fifo_executor.h"
+#include "lifo_executor.h"
+#include "numa.h"
+#include "priority_executor.h"
+#include "run_queue.h"
+#include "snapshot.h"
+#include "stats_reporter.h"
+#include "timer_wheel.h"
+#include "topology.h"
 
 namespace theta {
 
 class Executor;
 
+enum class WorkerPinning {
+  // Workers float wherever the kernel puts them.
+  kNone,
+  // Each worker is pinned to the SMT siblings of one core.
+  kPerCore,
+  // Each worker is pinned to the CPUs that share one last-level cache.
+  kPerLlc,
+};
+
 // The ThrottlingThreadpool can be configured to only allow running/prioritized
 // tasks on a subset of available cores. A throttled task may run on any core.
 // When a throttled task is a candidate to be promoted to a running/prioritized
 // task, if it is running on one of the quiet cores, the scaler may use various
 // heuristics and leave it in a throttled state.
+//
+// On a machine with several NUMA nodes, the pool keeps a run queue and a
+// group of workers per node, and each executor queues its tasks on its
+// preferred node. A worker only runs another node's task when that node is
+// out of workers and this one has an idle worker.
 class ThrottlingThreadpool {
   friend class Executor;
   friend class Impl;
@@ -38,12 +65,67 @@ class ThrottlingThreadpool {
       return *this;
     }
 
+    // The most workers that may exist at once. Workers beyond core_threads
+    // are started when a task is queued and no worker is idle, and exit after
+    // idle_timeout without work.
     size_t thread_limit() const { return thread_limit_; }
     ConfigureOpts& set_thread_limit(size_t val) {
       thread_limit_ = val;
       return *this;
     }
 
+    // The number of workers that are kept even when they are idle.
+    size_t core_threads() const { return core_threads_; }
+    ConfigureOpts& set_core_threads(size_t val) {
+      core_threads_ = val;
+      return *this;
+    }
+
+    // Only applies to workers that are started after it is configured.
+    std::chrono::milliseconds idle_timeout() const { return idle_timeout_; }
+    ConfigureOpts& set_idle_timeout(std::chrono::milliseconds val) {
+      idle_timeout_ = val;
+      return *this;
+    }
+
+    // How long an idle worker may spin before it blocks, to take the next
+    // task without a futex wake. Spinning stops sooner while it keeps
+    // missing. Zero, the default, never spins.
+    std::chrono::microseconds idle_spin() const { return idle_spin_; }
+    ConfigureOpts& set_idle_spin(std::chrono::microseconds val) {
+      idle_spin_ = val;
+      return *this;
+    }
+
+    // The most workers per NUMA node that spin at once. The rest block right
+    // away.
+    size_t idle_spinners() const { return idle_spinners_; }
+    ConfigureOpts& set_idle_spinners(size_t val) {
+      idle_spinners_ = val;
+      return *this;
+    }
+
+    // Pins workers to cores or cache groups, round robin in node order, so
+    // that their tasks are never migrated across sockets. Only applies to
+    // workers that are started after it is configured.
+    WorkerPinning worker_pinning() const { return worker_pinning_; }
+    ConfigureOpts& set_worker_pinning(WorkerPinning val) {
+      worker_pinning_ = val;
+      return *this;
+    }
+
+    // Moves a worker onto one SMT sibling per core of its CPUs while its task
+    // is throttled, so that CPU-heavy throttled tasks never take both
+    // siblings of a core. Only applies to workers that are started after it
+    // is configured.
+    bool smt_aware_throttling() const { return smt_aware_throttling_; }
+    ConfigureOpts& set_smt_aware_throttling(bool val) {
+      smt_aware_throttling_ = val;
+      return *this;
+    }
+
+    // How often the scaler folds worker usage into the executor stats and
+    // republishes the executor limits. Must be positive. Defaults to 100ms.
     std::chrono::milliseconds throttle_interval() const {
       return throttle_interval_;
     }
@@ -52,12 +134,44 @@ class ThrottlingThreadpool {
       return *this;
     }
 
+    // When set, a StatsReporter hands every executor's stats to the sink
+    // once per stats_interval.
+    const StatsReporter::Sink& stats_sink() const { return stats_sink_; }
+    ConfigureOpts& set_stats_sink(StatsReporter::Sink val) {
+      stats_sink_ = std::move(val);
+      return *this;
+    }
+
+    StatsReporter::Format stats_format() const { return stats_format_; }
+    ConfigureOpts& set_stats_format(StatsReporter::Format val) {
+      stats_format_ = val;
+      return *this;
+    }
+
+    // Must be positive when a sink is set. Defaults to 10s.
+    std::chrono::milliseconds stats_interval() const {
+      return stats_interval_;
+    }
+    ConfigureOpts& set_stats_interval(std::chrono::milliseconds val) {
+      stats_interval_ = val;
+      return *this;
+    }
+
     static ConfigureOpts defaultOpts();
 
    private:
     size_t nice_cores_{0};
     size_t thread_limit_{0};
-    std::chrono::milliseconds throttle_interval_{0};
+    size_t core_threads_{0};
+    std::chrono::milliseconds idle_timeout_{0};
+    std::chrono::microseconds idle_spin_{0};
+    size_t idle_spinners_{1};
+    WorkerPinning worker_pinning_{WorkerPinning::kNone};
+    bool smt_aware_throttling_{false};
+    std::chrono::milliseconds throttle_interval_{100};
+    StatsReporter::Sink stats_sink_{nullptr};
+    StatsReporter::Format stats_format_{StatsReporter::Format::kPrometheus};
+    std::chrono::milliseconds stats_interval_{std::chrono::seconds{10}};
   };
 
   static ThrottlingThreadpool& getInstance();
@@ -70,21 +184,88 @@ class ThrottlingThreadpool {
   void configure(const ConfigureOpts& opts);
 
   Executor create(Executor::Opts opts);
+
+  // The number of CPUs that the process may use, as of the last refresh. This
+  // honors the affinity mask and cgroup limits.
+  double cpu_capacity() const {
+    return cpu_capacity_.load(std::memory_order::acquire);
+  }
+
+  // The CPUs, caches and NUMA nodes of the machine, e.g. to shard per node.
+  const CpuTopology& topology() const { return CpuTopology::get(); }
+
+  // The current stats of every executor, e.g. to serve a scrape on demand.
+  std::vector<ExecutorSnapshot> stats_snapshot();
+  std::string render_stats(StatsReporter::Format format);
+
   // TODO(lpe): Allow the Executor to clean itself up.
   //void remove(ExecutorImpl* executor);
 
  private:
   ThrottlingThreadpool();
 
-  void task_loop();
+  void scaler_loop();
+  void scale(double interval_sec);
+
+  void init_run_queues();
+  // Called when a push finds no idle worker. Serves every starved queue now
+  // if workers_mutex_ is free, and else leaves it to the holder.
+  void maybe_spawn_worker();
+  // Unlocks workers_mutex_, after serving the starved queues if a push asked
+  // for it while the mutex was held. Every holder that may run while tasks
+  // are pushed must unlock through here.
+  void unlock_workers(std::unique_lock<std::mutex>& l);
+  // Starts a worker for the queue, or else wakes an idle worker of another
+  // queue to steal from it.
+  void serve_starved_queue(const std::unique_lock<std::mutex>&, size_t queue);
+  void spawn_worker(const std::unique_lock<std::mutex>&, size_t queue);
+  bool retire_worker(bool idle);
+  std::unique_ptr<Task> steal_task(size_t thief);
 
+  // Guards executors_.
   std::shared_mutex shared_mutex_;
-  ConfigureOpts opts_;
+  // Read without a lock by the paths that start and retire workers, which
+  // can run while shared_mutex_ is held.
+  Snapshot<ConfigureOpts> opts_;
 
-  TaskQueue<> run_queue_;
+  // One per NUMA node that the process may run on, each allocated on its
+  // node. Fixed at construction, since executors hold on to them.
+  std::vector<NodeLocalPtr<RunQueue>> run_queues_;
+  // The node of each run queue.
+  std::vector<int> queue_nodes_;
+  // Indexed by node id. Nodes without a run queue map to the first one.
+  std::vector<size_t> queue_of_node_;
+
+  // Guards workers_ and worker_affinities_, and serializes starting workers.
+  std::mutex workers_mutex_;
+  // Set by a push that found no idle worker, until a holder of
+  // workers_mutex_ has served the starved queues.
+  std::atomic<bool> spawn_pending_{false};
   std::vector<std::unique_ptr<Worker>> workers_;
+  // Per run queue, handed out round robin to its new workers. Empty when
+  // workers float.
+  std::vector<std::vector<Worker::Affinity>> worker_affinities_;
+  std::vector<size_t> next_affinity_;
+  std::atomic<size_t> live_workers_{0};
 
   std::vector<std::unique_ptr<ExecutorImpl>> executors_;
+
+  // Serves post_after, post_at and post_every for every executor. It is
+  // stopped before the workers, so that no timer posts into a pool that is
+  // shutting down.
+  std::unique_ptr<TimerService> timers_;
+
+  std::atomic<double> cpu_capacity_{1.0};
+
+  std::mutex scaler_mutex_;
+  std::condition_variable scaler_cv_;
+  bool scaler_shutdown_{false};
+  std::thread scaler_thread_;
+
+  // Guards reporter_. The reporter takes shared_mutex_ to snapshot, so it
+  // must never be destroyed while shared_mutex_ is held.
+  std::mutex reporter_mutex_;
+  std::unique_ptr<StatsReporter> reporter_;
 };
 
 }  // namespace theta
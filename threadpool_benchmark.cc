@@ -1,9 +1,16 @@
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <memory>
 #include <semaphore>
+#include <thread>
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "queue.h"
+#include "run_queue.h"
 #include "semaphore.h"
 #include "threadpool.h"
 
@@ -49,6 +56,70 @@ BENCHMARK_TEMPLATE(BM_queue, TaskQueue<std::counting_semaphore<100>>)
     ->Threads(2)
     ->Threads(10);
 
+// BM_queue through one RunQueue lane per thread, as executors use it.
+static void BM_run_queue(benchmark::State &state) {
+  static std::atomic<RunQueue *> rq{nullptr};
+  static std::atomic<int> workers{0};
+
+  if (state.thread_index() == 0) {
+    rq.store(new RunQueue{}, std::memory_order::release);
+  }
+
+  workers.fetch_add(1, std::memory_order::acq_rel);
+  RunQueue *run_queue{nullptr};
+  do {
+    run_queue = rq.load(std::memory_order::acquire);
+  } while (!run_queue);
+
+  RunQueue::Lane lane{1};
+  for (auto _ : state) {
+    run_queue->push(&lane, std::make_unique<Task>(Task::Opts{}));
+    run_queue->wait_pop();
+  }
+
+  workers.fetch_sub(1, std::memory_order::acq_rel);
+
+  if (state.thread_index() == 0) {
+    while (workers.load(std::memory_order::acq_rel)) {
+    }
+    run_queue->shutdown();
+    delete rq.exchange(nullptr);
+  }
+}
+BENCHMARK(BM_run_queue)->Threads(1)->Threads(2)->Threads(10);
+
+// Every task runs far longer than its lane's estimate, so that each pop
+// finds every lane on the ring in debt. Arg is the number of lanes.
+static void BM_run_queue_in_debt(benchmark::State &state) {
+  RunQueue run_queue;
+  std::vector<std::unique_ptr<RunQueue::Lane>> lanes;
+  for (int i = 0; i < state.range(0); i++) {
+    lanes.push_back(std::make_unique<RunQueue::Lane>(1));
+  }
+
+  RunQueue::Lane *ran = nullptr;
+  auto push = [&](RunQueue::Lane *lane) {
+    run_queue.push(lane, std::make_unique<Task>(
+                             Task::Opts{}.set_func([&ran, lane]() {
+                               ran = lane;
+                             })));
+  };
+  // Keeps every lane on the ring.
+  for (auto &lane : lanes) {
+    push(lane.get());
+  }
+
+  size_t next = 0;
+  for (auto _ : state) {
+    push(lanes[next++ % lanes.size()].get());
+    auto task = run_queue.maybe_pop();
+    task->opts().func()();
+    RunQueue::charge(ran, task.get(),
+                     RunQueue::kMaxDebtQuanta * RunQueue::kQuantumUsec);
+  }
+}
+BENCHMARK(BM_run_queue_in_debt)->Arg(1)->Arg(8)->Arg(64);
+
 template <typename SemaphoreType>
 static void BM_semaphore(benchmark::State &state) {
   static SemaphoreType sem{0};
@@ -64,10 +135,11 @@ BENCHMARK_TEMPLATE(BM_semaphore, std::counting_semaphore<100>)
     ->Threads(1)
     ->Threads(2);
 
+template <PriorityPolicy kPolicy>
 static void BM_empty_tasks(benchmark::State &state) {
   Executor executor = ThrottlingThreadpool::getInstance().create(
       Executor::Opts{}
-          .set_priority_policy(PriorityPolicy::FIFO)
+          .set_priority_policy(kPolicy)
           .set_thread_weight(state.range(0))
           .set_worker_limit(state.range(0)));
 
@@ -90,7 +162,196 @@ static void BM_empty_tasks(benchmark::State &state) {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
   }
 }
-BENCHMARK(BM_empty_tasks)->Args({1})->Args({2})->Args({11})->Args({100});
+BENCHMARK_TEMPLATE(BM_empty_tasks, PriorityPolicy::FIFO)
+    ->Args({1})
+    ->Args({2})
+    ->Args({11})
+    ->Args({100});
+BENCHMARK_TEMPLATE(BM_empty_tasks, PriorityPolicy::LIFO)
+    ->Args({1})
+    ->Args({2})
+    ->Args({11})
+    ->Args({100});
+
+// Each task fills a buffer and posts a task that reads it back, as in a
+// recursive divide and conquer. With LIFO the reader usually runs next, while
+// the buffer is still in cache. Under FIFO it waits behind every other
+// chain's tasks.
+template <PriorityPolicy kPolicy>
+static void BM_produce_consume(benchmark::State &state) {
+  static constexpr size_t kBufferBytes = 256 * 1024;
+  static constexpr int kChains = 64;
+
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(kPolicy)
+          .set_thread_weight(state.range(0))
+          .set_worker_limit(state.range(0)));
+
+  std::atomic<int64_t> consumed{0};
+  std::atomic<bool> stop{false};
+  std::atomic<int> outstanding{0};
+
+  std::function<void()> produce = [&]() {
+    auto buffer = std::make_shared<std::vector<char>>(kBufferBytes);
+    for (size_t i = 0; i < buffer->size(); i += 64) {
+      (*buffer)[i] = static_cast<char>(i);
+    }
+    executor.post([&, buffer]() {
+      int64_t sum = 0;
+      for (size_t i = 0; i < buffer->size(); i += 64) {
+        sum += (*buffer)[i];
+      }
+      benchmark::DoNotOptimize(sum);
+      consumed.fetch_add(1, std::memory_order::relaxed);
+      if (stop.load(std::memory_order::acquire)) {
+        outstanding.fetch_sub(1, std::memory_order::acq_rel);
+        return;
+      }
+      executor.post(produce);
+    });
+  };
+
+  for (int i = 0; i < kChains; i++) {
+    outstanding.fetch_add(1, std::memory_order::acq_rel);
+    executor.post(produce);
+  }
+
+  for (auto _ : state) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  stop.store(true, std::memory_order::release);
+  while (outstanding.load(std::memory_order::acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  state.counters["consumed_per_sec"] = benchmark::Counter(
+      consumed.load(std::memory_order::relaxed), benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE(BM_produce_consume, PriorityPolicy::FIFO)
+    ->Args({1})
+    ->Args({4})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_produce_consume, PriorityPolicy::LIFO)
+    ->Args({1})
+    ->Args({4})
+    ->UseRealTime();
+
+// Three executors with weights 1, 2 and 4 keep the pool saturated with CPU
+// bound tasks. The share_wN counters report the fraction of the total task
+// wall time that went to the executor with weight N, which should approach
+// N / 7.
+static void BM_weighted_shares(benchmark::State &state) {
+  static constexpr std::array<size_t, 3> kWeights{1, 2, 4};
+  static constexpr auto kTaskDuration = std::chrono::microseconds{200};
+
+  auto spin = [](std::chrono::microseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+  };
+
+  std::vector<Executor> executors;
+  for (size_t weight : kWeights) {
+    executors.push_back(ThrottlingThreadpool::getInstance().create(
+        Executor::Opts{}
+            .set_priority_policy(PriorityPolicy::FIFO)
+            .set_thread_weight(weight)
+            .set_worker_limit(Executor::Opts::kNoWorkerLimit)));
+  }
+
+  std::array<std::atomic<int64_t>, kWeights.size()> busy_usec{};
+  std::atomic<bool> stop{false};
+  std::atomic<int> outstanding{0};
+
+  // Each chain reposts itself, so every executor stays backlogged until stop.
+  std::function<void(size_t)> chain = [&](size_t i) {
+    auto begin = std::chrono::steady_clock::now();
+    spin(kTaskDuration);
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+    busy_usec[i].fetch_add(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(),
+        std::memory_order::relaxed);
+    if (stop.load(std::memory_order::acquire)) {
+      outstanding.fetch_sub(1, std::memory_order::acq_rel);
+      return;
+    }
+    executors[i].post([&chain, i]() { chain(i); });
+  };
+
+  size_t chains_per_executor =
+      4 * std::ceil(ThrottlingThreadpool::getInstance().cpu_capacity());
+  for (size_t i = 0; i < executors.size(); i++) {
+    for (size_t j = 0; j < chains_per_executor; j++) {
+      outstanding.fetch_add(1, std::memory_order::acq_rel);
+      executors[i].post([&chain, i]() { chain(i); });
+    }
+  }
+
+  for (auto _ : state) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  stop.store(true, std::memory_order::release);
+  while (outstanding.load(std::memory_order::acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  int64_t total = 0;
+  for (auto &usec : busy_usec) {
+    total += usec.load(std::memory_order::relaxed);
+  }
+  for (size_t i = 0; i < kWeights.size(); i++) {
+    state.counters["share_w" + std::to_string(kWeights[i])] =
+        total ? static_cast<double>(busy_usec[i].load()) / total : 0.0;
+  }
+}
+BENCHMARK(BM_weighted_shares)->Iterations(50)->UseRealTime();
+
+// One task at a time, each posted a short while after the previous one
+// started, so the worker has always just gone idle. Reports the time from
+// post until the task starts. With idle_spin off, every post pays for waking
+// a blocked worker. Arg is idle_spin in microseconds.
+static void BM_post_to_start(benchmark::State &state) {
+  static constexpr auto kGap = std::chrono::microseconds{20};
+
+  auto &pool = ThrottlingThreadpool::getInstance();
+  pool.configure(ThrottlingThreadpool::ConfigureOpts::defaultOpts()
+                     .set_idle_spin(std::chrono::microseconds{state.range(0)})
+                     .set_idle_spinners(1));
+  Executor executor = pool.create(Executor::Opts{}
+                                      .set_priority_policy(PriorityPolicy::FIFO)
+                                      .set_worker_limit(1));
+
+  using Clock = std::chrono::steady_clock;
+  auto now_nsec = []() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+  };
+  std::atomic<int64_t> started_nsec{0};
+
+  for (auto _ : state) {
+    auto gap_end = Clock::now() + kGap;
+    while (Clock::now() < gap_end) {
+    }
+
+    started_nsec.store(0, std::memory_order::relaxed);
+    int64_t posted = now_nsec();
+    executor.post([&]() {
+      started_nsec.store(now_nsec(), std::memory_order::release);
+    });
+    int64_t started;
+    while (!(started = started_nsec.load(std::memory_order::acquire))) {
+    }
+
+    state.SetIterationTime((started - posted) / 1e9);
+  }
+
+  pool.configure(ThrottlingThreadpool::ConfigureOpts::defaultOpts());
+}
+BENCHMARK(BM_post_to_start)->Arg(0)->Arg(50)->Arg(200)->UseManualTime();
 
 }  // namespace theta
 
@@ -0,0 +1,302 @@
+#include "timer_wheel.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <bit>
+
+namespace theta {
+
+TimerWheel::~TimerWheel() {
+  for (auto& [id, timer] : timers_) {
+    delete timer;
+  }
+}
+
+TimerId TimerWheel::insert(int64_t deadline_tick, int64_t period_ticks,
+                           ExecutorImpl* executor, Func func) {
+  CHECK_GE(period_ticks, 0);
+  TimerId id = next_id_++;
+  auto* timer = new Timer{
+      .id = id,
+      .deadline_tick = std::max(deadline_tick, now_tick_ + 1),
+      .period_ticks = period_ticks,
+      .executor = executor,
+      .func = std::move(func),
+  };
+  timers_.emplace(id, timer);
+  place(timer, nullptr);
+  return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  auto it = timers_.find(id);
+  if (it == timers_.end()) {
+    return false;
+  }
+  Timer* timer = it->second;
+  timers_.erase(it);
+
+  // A periodic timer that advance() handed out is not linked. Whoever holds
+  // it finds it gone from timers_ in reschedule() and deletes it.
+  if (timer->level >= 0) {
+    unlink(timer);
+    delete timer;
+  }
+  return true;
+}
+
+void TimerWheel::advance(int64_t to_tick, std::vector<Timer*>* expired) {
+  while (true) {
+    int64_t next = next_event_tick();
+    if (next > to_tick) {
+      break;
+    }
+    now_tick_ = next;
+    process_tick(expired);
+  }
+  now_tick_ = std::max(now_tick_, to_tick);
+}
+
+void TimerWheel::reschedule(Timer* timer) {
+  DCHECK_GT(timer->period_ticks, 0);
+  if (!timers_.count(timer->id)) {
+    delete timer;
+    return;
+  }
+
+  int64_t deadline = timer->deadline_tick + timer->period_ticks;
+  if (deadline <= now_tick_) {
+    int64_t missed = (now_tick_ - deadline) / timer->period_ticks + 1;
+    deadline += missed * timer->period_ticks;
+  }
+  timer->deadline_tick = deadline;
+  place(timer, nullptr);
+}
+
+void TimerWheel::release(Timer* timer) {
+  auto it = timers_.find(timer->id);
+  if (it != timers_.end() && it->second == timer) {
+    timers_.erase(it);
+  }
+  delete timer;
+}
+
+int64_t TimerWheel::next_event_tick() const {
+  // Every event on a level comes after every event on the finer levels, so
+  // the first occupied level has the earliest event.
+  for (int level = 0; level < kLevels; level++) {
+    int cur = slot_of(now_tick_, level);
+    DCHECK_EQ(occupied_[level] & ((uint64_t{2} << cur) - 1), 0);
+    uint64_t later =
+        cur + 1 < kSlots ? occupied_[level] & (~uint64_t{0} << (cur + 1)) : 0;
+    if (later) {
+      int shift = level * kSlotBits;
+      int64_t base = (now_tick_ >> (shift + kSlotBits)) << (shift + kSlotBits);
+      return base + (int64_t{std::countr_zero(later)} << shift);
+    }
+  }
+
+  if (overflow_.head) {
+    constexpr int kShift = kLevels * kSlotBits;
+    return ((now_tick_ >> kShift) + 1) << kShift;
+  }
+  return kNever;
+}
+
+void TimerWheel::place(Timer* timer, std::vector<Timer*>* expired) {
+  int64_t deadline = timer->deadline_tick;
+  if (deadline <= now_tick_) {
+    DCHECK(expired);
+    timer->level = -1;
+    if (!timer->period_ticks) {
+      timers_.erase(timer->id);
+    }
+    expired->push_back(timer);
+    return;
+  }
+
+  // The coarsest level where the deadline and now differ.
+  int level = (63 - std::countl_zero(
+                        static_cast<uint64_t>(deadline ^ now_tick_))) /
+              kSlotBits;
+  if (level >= kLevels) {
+    link(timer, kLevels, 0);
+  } else {
+    link(timer, level, slot_of(deadline, level));
+  }
+}
+
+void TimerWheel::link(Timer* timer, int level, int slot) {
+  Slot& s = level == kLevels ? overflow_ : levels_[level][slot];
+  timer->level = level;
+  timer->slot = slot;
+  timer->prev = s.tail;
+  timer->next = nullptr;
+  if (s.tail) {
+    s.tail->next = timer;
+  } else {
+    s.head = timer;
+    if (level < kLevels) {
+      occupied_[level] |= uint64_t{1} << slot;
+    }
+  }
+  s.tail = timer;
+}
+
+void TimerWheel::unlink(Timer* timer) {
+  Slot& s =
+      timer->level == kLevels ? overflow_ : levels_[timer->level][timer->slot];
+  (timer->prev ? timer->prev->next : s.head) = timer->next;
+  (timer->next ? timer->next->prev : s.tail) = timer->prev;
+  if (!s.head && timer->level < kLevels) {
+    occupied_[timer->level] &= ~(uint64_t{1} << timer->slot);
+  }
+  timer->prev = nullptr;
+  timer->next = nullptr;
+  timer->level = -1;
+}
+
+void TimerWheel::spread(int level, int slot, std::vector<Timer*>* expired) {
+  // Detach the whole list first, since an overflow timer that is still out
+  // of range goes back onto the same list.
+  Slot& s = level == kLevels ? overflow_ : levels_[level][slot];
+  Timer* timer = s.head;
+  s.head = nullptr;
+  s.tail = nullptr;
+  if (level < kLevels) {
+    occupied_[level] &= ~(uint64_t{1} << slot);
+  }
+
+  while (timer) {
+    Timer* next = timer->next;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    timer->level = -1;
+    place(timer, expired);
+    timer = next;
+  }
+}
+
+void TimerWheel::process_tick(std::vector<Timer*>* expired) {
+  // Coarse slots that start at this tick move down first, so that the finer
+  // levels see them below.
+  constexpr int64_t kOverflowMask = (int64_t{1} << (kLevels * kSlotBits)) - 1;
+  if ((now_tick_ & kOverflowMask) == 0) {
+    spread(kLevels, 0, expired);
+  }
+  for (int level = kLevels - 1; level > 0; level--) {
+    int64_t mask = (int64_t{1} << (level * kSlotBits)) - 1;
+    if ((now_tick_ & mask) == 0) {
+      spread(level, slot_of(now_tick_, level), expired);
+    }
+  }
+
+  // Everything left on level 0 at this slot is due now.
+  spread(0, slot_of(now_tick_, 0), expired);
+}
+
+TimerService::TimerService(Dispatch dispatch)
+    : dispatch_(std::move(dispatch)),
+      origin_(Clock::now()),
+      thread_(&TimerService::run_loop, this) {
+  CHECK(dispatch_);
+}
+
+TimerService::~TimerService() {
+  {
+    std::lock_guard l{mutex_};
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+TimerId TimerService::schedule(ExecutorImpl* executor,
+                               Clock::time_point deadline,
+                               Clock::duration period, Func func) {
+  CHECK(func);
+  CHECK_GE(period.count(), 0);
+  int64_t deadline_tick = ceil_ticks(deadline - origin_);
+  int64_t period_ticks = ceil_ticks(period);
+
+  TimerId id;
+  bool wake;
+  {
+    std::lock_guard l{mutex_};
+    id = wheel_.insert(deadline_tick, period_ticks, executor, std::move(func));
+    wake = deadline_tick < wake_tick_;
+  }
+  if (wake) {
+    cv_.notify_one();
+  }
+  return id;
+}
+
+bool TimerService::cancel(TimerId id) {
+  std::lock_guard l{mutex_};
+  return wheel_.cancel(id);
+}
+
+size_t TimerService::size() {
+  std::lock_guard l{mutex_};
+  return wheel_.size();
+}
+
+int64_t TimerService::to_tick(Clock::time_point time) const {
+  return std::chrono::floor<Tick>(time - origin_) / kTick;
+}
+
+/*static*/
+int64_t TimerService::ceil_ticks(Clock::duration duration) {
+  return std::chrono::ceil<Tick>(duration) / kTick;
+}
+
+TimerService::Clock::time_point TimerService::to_time(int64_t tick) const {
+  return origin_ + tick * kTick;
+}
+
+void TimerService::run_loop() {
+  std::vector<TimerWheel::Timer*> expired;
+  std::vector<std::pair<ExecutorImpl*, std::vector<Func>>> batches;
+
+  std::unique_lock l{mutex_};
+  while (!shutdown_) {
+    wheel_.advance(to_tick(Clock::now()), &expired);
+    if (expired.empty()) {
+      wake_tick_ = wheel_.next_event_tick();
+      if (wake_tick_ == TimerWheel::kNever) {
+        cv_.wait(l);
+      } else {
+        cv_.wait_until(l, to_time(wake_tick_));
+      }
+      continue;
+    }
+
+    for (auto* timer : expired) {
+      auto it = std::find_if(batches.begin(), batches.end(), [&](auto& b) {
+        return b.first == timer->executor;
+      });
+      if (it == batches.end()) {
+        it = batches.insert(batches.end(), {timer->executor, {}});
+      }
+      if (timer->period_ticks) {
+        it->second.push_back(timer->func);
+        wheel_.reschedule(timer);
+      } else {
+        it->second.push_back(std::move(timer->func));
+        wheel_.release(timer);
+      }
+    }
+    expired.clear();
+
+    l.unlock();
+    for (auto& [executor, funcs] : batches) {
+      dispatch_(executor, std::move(funcs));
+    }
+    batches.clear();
+    l.lock();
+  }
+}
+
+}  // namespace theta
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace theta {
+
+class ExecutorImpl;
+
+using TimerId = uint64_t;
+constexpr TimerId kInvalidTimerId = 0;
+
+// A hierarchical timing wheel. Time is counted in integer ticks. Level L has
+// kSlots slots that each cover kSlots^L ticks, so a timer is inserted at the
+// coarsest level where its deadline still differs from the current tick, and
+// moves down a level each time the wheel reaches the start of its slot. A
+// per-level bitmap of occupied slots lets advance() jump straight to the next
+// tick where something happens, so an idle wheel costs nothing.
+//
+// Insert and cancel are O(1). Timers further out than the top level covers
+// wait in an overflow list that is re-examined once per top-level rotation.
+//
+// Not thread-safe. TimerService adds the locking and the thread.
+class TimerWheel {
+ public:
+  using Func = std::function<void()>;
+
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+  static constexpr int kLevels = 4;
+  static constexpr int64_t kNever = std::numeric_limits<int64_t>::max();
+
+  struct Timer {
+    TimerId id;
+    int64_t deadline_tick;
+    // Zero for one-shot timers.
+    int64_t period_ticks;
+    ExecutorImpl* executor;
+    Func func;
+
+    Timer* prev{nullptr};
+    Timer* next{nullptr};
+    // kLevels for the overflow list.
+    int level{0};
+    int slot{0};
+  };
+
+  explicit TimerWheel(int64_t now_tick = 0) : now_tick_(now_tick) {}
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  int64_t now_tick() const { return now_tick_; }
+  size_t size() const { return timers_.size(); }
+
+  // A deadline that is not after now_tick() fires on the next tick.
+  TimerId insert(int64_t deadline_tick, int64_t period_ticks,
+                 ExecutorImpl* executor, Func func);
+
+  // Returns false if the timer already fired or was cancelled. A periodic
+  // timer can be cancelled at any time.
+  bool cancel(TimerId id);
+
+  // Moves the wheel to to_tick and appends the timers that are due, in
+  // deadline order. One-shot timers are released to the caller. Periodic
+  // timers stay owned by the wheel and must be handed back to reschedule()
+  // or release().
+  void advance(int64_t to_tick, std::vector<Timer*>* expired);
+
+  // Puts a periodic timer back for the first deadline after now_tick().
+  // Missed periods are skipped rather than fired back to back.
+  void reschedule(Timer* timer);
+  void release(Timer* timer);
+
+  // The earliest tick at which advance() has work to do: either a timer is
+  // due, or a slot on a coarser level must be spread onto the finer ones.
+  // This is never later than the earliest deadline.
+  int64_t next_event_tick() const;
+
+ private:
+  // Timers are appended, so that timers with the same deadline fire in the
+  // order that they were inserted.
+  struct Slot {
+    Timer* head{nullptr};
+    Timer* tail{nullptr};
+  };
+
+  std::array<std::array<Slot, kSlots>, kLevels> levels_;
+  std::array<uint64_t, kLevels> occupied_{};
+  Slot overflow_;
+
+  int64_t now_tick_;
+  TimerId next_id_{kInvalidTimerId + 1};
+  std::unordered_map<TimerId, Timer*> timers_;
+
+  static int slot_of(int64_t tick, int level) {
+    return (tick >> (level * kSlotBits)) & (kSlots - 1);
+  }
+
+  // Links the timer into the slot for its deadline, or into expired when
+  // the deadline is not after now_tick_.
+  void place(Timer* timer, std::vector<Timer*>* expired);
+  void link(Timer* timer, int level, int slot);
+  void unlink(Timer* timer);
+  // Re-places every timer of a slot. level is kLevels for the overflow list.
+  void spread(int level, int slot, std::vector<Timer*>* expired);
+  void process_tick(std::vector<Timer*>* expired);
+};
+
+// Runs a TimerWheel on its own thread, which sleeps until the wheel's next
+// event. Due timers are grouped by executor and handed to the dispatch
+// function in batches, in deadline order within each executor.
+class TimerService {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Func = TimerWheel::Func;
+  using Dispatch =
+      std::function<void(ExecutorImpl* executor, std::vector<Func> funcs)>;
+
+  using Tick = std::chrono::milliseconds;
+  static constexpr Tick kTick{1};
+
+  explicit TimerService(Dispatch dispatch);
+  ~TimerService();
+
+  TimerService(const TimerService&) = delete;
+  TimerService& operator=(const TimerService&) = delete;
+
+  // A non-zero period repeats the timer every period after the first
+  // deadline until it is cancelled. Deadlines round up to the next tick, so
+  // a timer never fires early.
+  TimerId schedule(ExecutorImpl* executor, Clock::time_point deadline,
+                   Clock::duration period, Func func);
+  bool cancel(TimerId id);
+
+  size_t size();
+
+ private:
+  const Dispatch dispatch_;
+  const Clock::time_point origin_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  TimerWheel wheel_;
+  // The tick that the thread is sleeping until, so that schedule() only
+  // wakes it for an earlier deadline.
+  int64_t wake_tick_{TimerWheel::kNever};
+  bool shutdown_{false};
+  std::thread thread_;
+
+  // Rounds down, for the current time.
+  int64_t to_tick(Clock::time_point time) const;
+  // Rounds up, for deadlines and periods.
+  static int64_t ceil_ticks(Clock::duration duration);
+  Clock::time_point to_time(int64_t tick) const;
+
+  void run_loop();
+};
+
+}  // namespace theta
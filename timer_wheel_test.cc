@@ -0,0 +1,283 @@
+#include "timer_wheel.h"
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <latch>
+#include <mutex>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadpool.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Records the value of each timer that fires, in firing order.
+class Recorder {
+ public:
+  TimerWheel::Func func(int val) {
+    return [this, val]() { fired_.push_back(val); };
+  }
+
+  // Runs and releases everything that is due by to_tick.
+  void advance(TimerWheel* wheel, int64_t to_tick) {
+    std::vector<TimerWheel::Timer*> expired;
+    wheel->advance(to_tick, &expired);
+    for (auto* timer : expired) {
+      timer->func();
+      if (timer->period_ticks) {
+        wheel->reschedule(timer);
+      } else {
+        wheel->release(timer);
+      }
+    }
+  }
+
+  const std::vector<int>& fired() const { return fired_; }
+
+ private:
+  std::vector<int> fired_;
+};
+
+}  // namespace
+
+TEST(TimerWheel, fires_at_the_deadline_on_every_level) {
+  TimerWheel wheel;
+  Recorder recorder;
+
+  // One deadline per level, plus one in the overflow list.
+  const std::vector<int64_t> deadlines = {5, 64 * 3 + 1, 64 * 64 * 5 + 7,
+                                          64 * 64 * 64 * 2 + 3,
+                                          int64_t{64} * 64 * 64 * 64 * 2 + 9};
+  for (size_t i = 0; i < deadlines.size(); i++) {
+    wheel.insert(deadlines[i], 0, nullptr, recorder.func(i));
+  }
+  EXPECT_EQ(wheel.size(), deadlines.size());
+
+  for (size_t i = 0; i < deadlines.size(); i++) {
+    EXPECT_LE(wheel.next_event_tick(), deadlines[i]);
+    recorder.advance(&wheel, deadlines[i] - 1);
+    EXPECT_EQ(recorder.fired().size(), i) << deadlines[i];
+    recorder.advance(&wheel, deadlines[i]);
+    ASSERT_EQ(recorder.fired().size(), i + 1) << deadlines[i];
+    EXPECT_EQ(recorder.fired().back(), i);
+  }
+
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_EQ(wheel.next_event_tick(), TimerWheel::kNever);
+}
+
+TEST(TimerWheel, fires_in_deadline_order_across_a_jump) {
+  TimerWheel wheel{/*now_tick=*/1000};
+  Recorder recorder;
+
+  std::vector<int64_t> deadlines = {70000, 1001, 5000, 1001, 4097, 300000};
+  for (size_t i = 0; i < deadlines.size(); i++) {
+    wheel.insert(deadlines[i], 0, nullptr, recorder.func(i));
+  }
+  recorder.advance(&wheel, 1000000);
+
+  // Equal deadlines fire in insertion order.
+  EXPECT_EQ(recorder.fired(), (std::vector<int>{1, 3, 4, 2, 0, 5}));
+  EXPECT_EQ(wheel.now_tick(), 1000000);
+}
+
+TEST(TimerWheel, past_deadlines_fire_on_the_next_tick) {
+  TimerWheel wheel{/*now_tick=*/50};
+  Recorder recorder;
+
+  wheel.insert(10, 0, nullptr, recorder.func(0));
+  EXPECT_EQ(wheel.next_event_tick(), 51);
+  recorder.advance(&wheel, 51);
+  EXPECT_EQ(recorder.fired(), (std::vector<int>{0}));
+}
+
+TEST(TimerWheel, cancel) {
+  TimerWheel wheel;
+  Recorder recorder;
+
+  TimerId near = wheel.insert(10, 0, nullptr, recorder.func(0));
+  TimerId far = wheel.insert(100000, 0, nullptr, recorder.func(1));
+  TimerId kept = wheel.insert(20, 0, nullptr, recorder.func(2));
+  EXPECT_TRUE(wheel.cancel(near));
+  EXPECT_TRUE(wheel.cancel(far));
+  EXPECT_FALSE(wheel.cancel(far));
+  EXPECT_EQ(wheel.size(), 1);
+  EXPECT_EQ(wheel.next_event_tick(), 20);
+
+  recorder.advance(&wheel, 200000);
+  EXPECT_EQ(recorder.fired(), (std::vector<int>{2}));
+  // Timers that already fired cannot be cancelled.
+  EXPECT_FALSE(wheel.cancel(kept));
+  EXPECT_FALSE(wheel.cancel(kInvalidTimerId));
+}
+
+TEST(TimerWheel, periodic) {
+  TimerWheel wheel;
+  Recorder recorder;
+
+  TimerId id = wheel.insert(10, 10, nullptr, recorder.func(0));
+  for (int64_t tick = 1; tick <= 35; tick++) {
+    recorder.advance(&wheel, tick);
+  }
+  EXPECT_EQ(recorder.fired().size(), 3);
+
+  // A late advance skips the missed periods instead of catching up.
+  recorder.advance(&wheel, 1000);
+  EXPECT_EQ(recorder.fired().size(), 4);
+  recorder.advance(&wheel, 1010);
+  EXPECT_EQ(recorder.fired().size(), 5);
+
+  EXPECT_TRUE(wheel.cancel(id));
+  recorder.advance(&wheel, 2000);
+  EXPECT_EQ(recorder.fired().size(), 5);
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheel, cancel_while_handed_out) {
+  TimerWheel wheel;
+  TimerId id = wheel.insert(10, 10, nullptr, []() {});
+
+  std::vector<TimerWheel::Timer*> expired;
+  wheel.advance(10, &expired);
+  ASSERT_EQ(expired.size(), 1);
+
+  // The timer is deleted when it is handed back.
+  EXPECT_TRUE(wheel.cancel(id));
+  wheel.reschedule(expired[0]);
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_EQ(wheel.next_event_tick(), TimerWheel::kNever);
+}
+
+TEST(TimerService, dispatches_batches_per_executor) {
+  auto* a = reinterpret_cast<ExecutorImpl*>(0x10);
+  auto* b = reinterpret_cast<ExecutorImpl*>(0x20);
+
+  std::mutex mu;
+  std::vector<std::pair<ExecutorImpl*, size_t>> batches;
+  std::latch done{5};
+  TimerService service{[&](ExecutorImpl* executor,
+                           std::vector<TimerService::Func> funcs) {
+    {
+      std::lock_guard l{mu};
+      batches.emplace_back(executor, funcs.size());
+    }
+    for (auto& func : funcs) {
+      func();
+    }
+  }};
+
+  auto deadline = TimerService::Clock::now() + 20ms;
+  auto start = TimerService::Clock::now();
+  for (auto* executor : {a, b, a, a, b}) {
+    service.schedule(executor, deadline, 0ms, [&]() { done.count_down(); });
+  }
+  done.wait();
+
+  EXPECT_GE(TimerService::Clock::now() - start, 20ms);
+  std::lock_guard l{mu};
+  EXPECT_EQ(batches, (std::vector<std::pair<ExecutorImpl*, size_t>>{
+                         {a, 3}, {b, 2}}));
+}
+
+TEST(TimerService, periodic_and_cancel) {
+  std::atomic<int> runs{0};
+  TimerService service{
+      [](ExecutorImpl*, std::vector<TimerService::Func> funcs) {
+        for (auto& func : funcs) {
+          func();
+        }
+      }};
+
+  TimerId id = service.schedule(nullptr, TimerService::Clock::now() + 1ms,
+                                5ms, [&]() { runs.fetch_add(1); });
+  while (runs.load() < 3) {
+    std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_TRUE(service.cancel(id));
+  int after_cancel = runs.load();
+  std::this_thread::sleep_for(30ms);
+
+  // At most one run that was already handed out before the cancel.
+  EXPECT_LE(runs.load(), after_cancel + 1);
+  EXPECT_EQ(service.size(), 0);
+}
+
+TEST(ExecutorTimers, post_after_and_post_at) {
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}.set_priority_policy(PriorityPolicy::LIFO));
+
+  std::latch done{2};
+  auto start = Executor::Clock::now();
+  std::atomic<Executor::Clock::duration> after{};
+  std::atomic<Executor::Clock::duration> at{};
+  executor.post_after(10ms, [&]() {
+    after.store(Executor::Clock::now() - start);
+    done.count_down();
+  });
+  executor.post_at(start + 20ms, [&]() {
+    at.store(Executor::Clock::now() - start);
+    done.count_down();
+  });
+  TimerId cancelled = executor.post_after(5ms, []() { ADD_FAILURE(); });
+  EXPECT_TRUE(executor.cancel(cancelled));
+  done.wait();
+
+  EXPECT_GE(after.load(), 10ms);
+  EXPECT_GE(at.load(), 20ms);
+}
+
+TEST(ExecutorTimers, due_timers_are_queued_before_any_runs) {
+  static constexpr int kTimers = 8;
+
+  // A single active slot is taken by whichever task is admitted first.
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}
+          .set_priority_policy(PriorityPolicy::LIFO)
+          .set_thread_weight(1)
+          .set_worker_limit(1));
+
+  std::mutex mu;
+  std::vector<int> order;
+  std::latch done{kTimers};
+  auto deadline = Executor::Clock::now() + 20ms;
+  for (int i = 0; i < kTimers; i++) {
+    executor.post_at(deadline, [&, i]() {
+      {
+        std::lock_guard l{mu};
+        order.push_back(i);
+      }
+      done.count_down();
+    });
+  }
+  done.wait();
+
+  // Had the timers been posted one at a time, the first would have been
+  // admitted before the others were queued, and would have run first.
+  ASSERT_EQ(order.size(), kTimers);
+  for (int i = 0; i < kTimers; i++) {
+    EXPECT_EQ(order[i], kTimers - 1 - i);
+  }
+}
+
+TEST(ExecutorTimers, post_every) {
+  Executor executor = ThrottlingThreadpool::getInstance().create(
+      Executor::Opts{}.set_priority_policy(PriorityPolicy::LIFO));
+
+  std::latch done{3};
+  std::atomic<int> runs{0};
+  TimerId id = executor.post_every(2ms, [&]() {
+    if (runs.fetch_add(1) < 3) {
+      done.count_down();
+    }
+  });
+  done.wait();
+  EXPECT_TRUE(executor.cancel(id));
+  EXPECT_FALSE(executor.cancel(id));
+}
+
+}  // namespace theta
@@ -0,0 +1,258 @@
+#include "topology.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#include "cpu_capacity.h"
+
+namespace theta {
+
+namespace {
+
+constexpr std::string_view kCpuDir = "/sys/devices/system/cpu";
+constexpr std::string_view kNodeDir = "/sys/devices/system/node";
+
+class SysfsReader {
+ public:
+  explicit SysfsReader(const std::string& root) : root_(root) {}
+
+  std::optional<std::string> read(const std::string& path) const {
+    std::ifstream in{root_ + path};
+    if (!in) {
+      return {};
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  std::vector<int> read_cpu_list(const std::string& path) const {
+    auto contents = read(path);
+    if (!contents.has_value()) {
+      return {};
+    }
+    return CpuCapacity::parse_cpu_list(contents.value());
+  }
+
+  std::optional<int> read_int(const std::string& path) const {
+    auto contents = read(path);
+    if (!contents.has_value()) {
+      return {};
+    }
+    std::string_view s = contents.value();
+    while (!s.empty() && (s.back() == '\n' || s.back() == ' ')) {
+      s.remove_suffix(1);
+    }
+    int val{};
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), val);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) {
+      return {};
+    }
+    return val;
+  }
+
+ private:
+  const std::string& root_;
+};
+
+std::string cpu_path(int cpu, std::string_view file) {
+  return std::string{kCpuDir} + "/cpu" + std::to_string(cpu) + "/" +
+         std::string{file};
+}
+
+// Keeps only the CPUs that are in online, and always at least cpu itself.
+std::vector<int> restrict_to(const std::vector<int>& cpus,
+                             const std::set<int>& online, int cpu) {
+  std::vector<int> result;
+  for (int c : cpus) {
+    if (online.contains(c)) {
+      result.push_back(c);
+    }
+  }
+  if (std::find(result.begin(), result.end(), cpu) == result.end()) {
+    result = {cpu};
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// The CPUs that share cpu's highest-level data or unified cache.
+std::vector<int> llc_of(const SysfsReader& sysfs, int cpu) {
+  int best_level = -1;
+  std::vector<int> best;
+  for (int index = 0;; index++) {
+    std::string dir = "cache/index" + std::to_string(index);
+    auto level = sysfs.read_int(cpu_path(cpu, dir + "/level"));
+    if (!level.has_value()) {
+      break;
+    }
+    auto type = sysfs.read(cpu_path(cpu, dir + "/type"));
+    if (type.has_value() && type->starts_with("Instruction")) {
+      continue;
+    }
+    if (level.value() > best_level) {
+      best_level = level.value();
+      best = sysfs.read_cpu_list(cpu_path(cpu, dir + "/shared_cpu_list"));
+    }
+  }
+  return best;
+}
+
+// Dedupes groups and orders them by the node of their lowest CPU, then by
+// that CPU. Returns each CPU's group index through group_of.
+std::vector<std::vector<int>> order_groups(
+    const std::map<int, std::vector<int>>& group_by_cpu,
+    const std::map<int, int>& node_by_cpu, std::map<int, size_t>* group_of) {
+  std::set<std::vector<int>> unique;
+  for (const auto& [cpu, group] : group_by_cpu) {
+    unique.insert(group);
+  }
+  std::vector<std::vector<int>> groups{unique.begin(), unique.end()};
+  std::stable_sort(groups.begin(), groups.end(),
+                   [&](const auto& a, const auto& b) {
+                     return node_by_cpu.at(a.front()) <
+                            node_by_cpu.at(b.front());
+                   });
+
+  std::map<std::vector<int>, size_t> index;
+  for (size_t i = 0; i < groups.size(); i++) {
+    index[groups[i]] = i;
+  }
+  for (const auto& [cpu, group] : group_by_cpu) {
+    (*group_of)[cpu] = index.at(group);
+  }
+  return groups;
+}
+
+}  // namespace
+
+/*static*/
+CpuTopology CpuTopology::detect(const std::string& root) {
+  SysfsReader sysfs{root};
+
+  std::vector<int> online_list =
+      sysfs.read_cpu_list(std::string{kCpuDir} + "/online");
+  if (online_list.empty()) {
+    unsigned num_cpus = std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < num_cpus; cpu++) {
+      online_list.push_back(cpu);
+    }
+  }
+  std::set<int> online{online_list.begin(), online_list.end()};
+
+  // A CPU that no node claims goes to the first node.
+  std::map<int, int> node_by_cpu;
+  std::map<int, std::vector<int>> node_cpus;
+  for (int node :
+       sysfs.read_cpu_list(std::string{kNodeDir} + "/online")) {
+    for (int cpu : sysfs.read_cpu_list(std::string{kNodeDir} + "/node" +
+                                       std::to_string(node) + "/cpulist")) {
+      if (online.contains(cpu) && !node_by_cpu.contains(cpu)) {
+        node_by_cpu[cpu] = node;
+        node_cpus[node].push_back(cpu);
+      }
+    }
+  }
+  int first_node = node_cpus.empty() ? 0 : node_cpus.begin()->first;
+  for (int cpu : online) {
+    if (!node_by_cpu.contains(cpu)) {
+      node_by_cpu[cpu] = first_node;
+      node_cpus[first_node].push_back(cpu);
+    }
+  }
+
+  std::map<int, std::vector<int>> core_by_cpu;
+  std::map<int, std::vector<int>> llc_by_cpu;
+  for (int cpu : online) {
+    core_by_cpu[cpu] = restrict_to(
+        sysfs.read_cpu_list(cpu_path(cpu, "topology/thread_siblings_list")),
+        online, cpu);
+
+    auto llc = llc_of(sysfs, cpu);
+    llc_by_cpu[cpu] = llc.empty() ? online_list : restrict_to(llc, online, cpu);
+  }
+
+  CpuTopology topology;
+  std::map<int, size_t> core_index;
+  std::map<int, size_t> llc_index;
+  topology.cores_ = order_groups(core_by_cpu, node_by_cpu, &core_index);
+  topology.llcs_ = order_groups(llc_by_cpu, node_by_cpu, &llc_index);
+  for (auto& [node, cpus] : node_cpus) {
+    std::sort(cpus.begin(), cpus.end());
+    topology.nodes_.push_back(Node{.id = node, .cpus = std::move(cpus)});
+  }
+
+  topology.cpu_index_.assign(*online.rbegin() + 1, -1);
+  for (int cpu : online) {
+    topology.cpu_index_[cpu] = topology.cpus_.size();
+    topology.cpus_.push_back(Cpu{.id = cpu,
+                                 .core = core_index.at(cpu),
+                                 .llc = llc_index.at(cpu),
+                                 .node = node_by_cpu.at(cpu)});
+  }
+  return topology;
+}
+
+/*static*/
+const CpuTopology& CpuTopology::get() {
+  static const CpuTopology topology = detect();
+  return topology;
+}
+
+const CpuTopology::Cpu* CpuTopology::cpu(int id) const {
+  if (id < 0 || static_cast<size_t>(id) >= cpu_index_.size() ||
+      cpu_index_[id] < 0) {
+    return nullptr;
+  }
+  return &cpus_[cpu_index_[id]];
+}
+
+int CpuTopology::node_of(int cpu) const {
+  const Cpu* c = this->cpu(cpu);
+  return c ? c->node : nodes_.front().id;
+}
+
+std::vector<int> CpuTopology::one_per_core(const std::vector<int>& cpus) const {
+  std::map<size_t, int> lowest;
+  for (int id : cpus) {
+    const Cpu* c = cpu(id);
+    if (!c) {
+      continue;
+    }
+    auto [it, inserted] = lowest.emplace(c->core, id);
+    if (!inserted) {
+      it->second = std::min(it->second, id);
+    }
+  }
+
+  std::vector<int> result;
+  for (const auto& [core, id] : lowest) {
+    result.push_back(id);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+int get_local_node() {
+  thread_local int remaining_uses = 0;
+  thread_local int node = 0;
+
+  if (remaining_uses) {
+    remaining_uses--;
+    return node;
+  }
+
+  remaining_uses = 31;
+  node = CpuTopology::get().node_of(sched_getcpu());
+  return node;
+}
+
+}  // namespace theta
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace theta {
+
+// The online CPUs of the machine, grouped by core (SMT siblings), last-level
+// cache and NUMA node, as described by /sys/devices/system/cpu and
+// /sys/devices/system/node. Anything that sysfs does not describe falls back
+// to a flat machine: every CPU is its own core, and all of them share one
+// cache and node 0.
+//
+// The groups are ordered by node and then by their lowest CPU, so that
+// walking them in order fills one node before the next.
+class CpuTopology {
+ public:
+  struct Cpu {
+    int id;
+    // Indexes into cores() and llcs().
+    size_t core;
+    size_t llc;
+    int node;
+  };
+
+  struct Node {
+    int id;
+    std::vector<int> cpus;
+  };
+
+  // The root is prepended to every path that is read, which lets tests point
+  // detection at a fake filesystem.
+  static CpuTopology detect(const std::string& root = "");
+
+  // The topology of this machine, detected on first use.
+  static const CpuTopology& get();
+
+  // Ordered by id.
+  const std::vector<Cpu>& cpus() const { return cpus_; }
+  // The CPU ids of each core and of each group of CPUs that share a
+  // last-level cache.
+  const std::vector<std::vector<int>>& cores() const { return cores_; }
+  const std::vector<std::vector<int>>& llcs() const { return llcs_; }
+  const std::vector<Node>& nodes() const { return nodes_; }
+
+  // Returns nullptr if the CPU is not online.
+  const Cpu* cpu(int id) const;
+  // The node of a CPU, or the first node if the CPU is not online.
+  int node_of(int cpu) const;
+
+  // One CPU per core of the given CPUs, the lowest of each core's siblings
+  // among them. Work that is limited to these never shares a core.
+  std::vector<int> one_per_core(const std::vector<int>& cpus) const;
+
+ private:
+  std::vector<Cpu> cpus_;
+  std::vector<std::vector<int>> cores_;
+  std::vector<std::vector<int>> llcs_;
+  std::vector<Node> nodes_;
+  // Indexed by CPU id, -1 for CPUs that are not online.
+  std::vector<int> cpu_index_;
+};
+
+// The NUMA node of the CPU that the calling thread runs on. Like
+// get_local_cpu(), this is cached for a few calls, so it can be stale right
+// after a migration.
+int get_local_node();
+
+}  // namespace theta
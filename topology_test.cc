@@ -0,0 +1,143 @@
+#include "topology.h"
+
+#include <glog/logging.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+namespace {
+
+class FakeRoot {
+ public:
+  FakeRoot()
+      : root_(std::filesystem::temp_directory_path() /
+              ("topology_test." + std::to_string(getpid()))) {
+    std::filesystem::remove_all(root_);
+  }
+
+  ~FakeRoot() { std::filesystem::remove_all(root_); }
+
+  void write(const std::string& path, const std::string& contents) {
+    auto full = root_ / path.substr(1);
+    std::filesystem::create_directories(full.parent_path());
+    std::ofstream{full} << contents;
+  }
+
+  std::string path() const { return root_.string(); }
+
+ private:
+  std::filesystem::path root_;
+};
+
+// Two sockets, each one node with one L3 and two cores of two threads. As on
+// most x86 machines, the siblings of core n on socket s are n and n + 4.
+void write_two_sockets(FakeRoot& root) {
+  root.write("/sys/devices/system/cpu/online", "0-7\n");
+  root.write("/sys/devices/system/node/online", "0-1\n");
+  root.write("/sys/devices/system/node/node0/cpulist", "0-1,4-5\n");
+  root.write("/sys/devices/system/node/node1/cpulist", "2-3,6-7\n");
+
+  for (int cpu = 0; cpu < 8; cpu++) {
+    std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    int core = cpu % 4;
+    root.write(dir + "/topology/thread_siblings_list",
+               std::to_string(core) + "," + std::to_string(core + 4) + "\n");
+
+    root.write(dir + "/cache/index0/level", "1\n");
+    root.write(dir + "/cache/index0/type", "Data\n");
+    root.write(dir + "/cache/index0/shared_cpu_list",
+               std::to_string(core) + "," + std::to_string(core + 4) + "\n");
+    root.write(dir + "/cache/index1/level", "1\n");
+    root.write(dir + "/cache/index1/type", "Instruction\n");
+    root.write(dir + "/cache/index1/shared_cpu_list",
+               std::to_string(core) + "," + std::to_string(core + 4) + "\n");
+    root.write(dir + "/cache/index2/level", "3\n");
+    root.write(dir + "/cache/index2/type", "Unified\n");
+    root.write(dir + "/cache/index2/shared_cpu_list",
+               core < 2 ? "0-1,4-5\n" : "2-3,6-7\n");
+  }
+}
+
+}  // namespace
+
+TEST(CpuTopology, two_sockets) {
+  FakeRoot root;
+  write_two_sockets(root);
+
+  auto topology = CpuTopology::detect(root.path());
+
+  ASSERT_EQ(topology.cpus().size(), 8);
+  EXPECT_EQ(topology.cores(), (std::vector<std::vector<int>>{
+                                  {0, 4}, {1, 5}, {2, 6}, {3, 7}}));
+  EXPECT_EQ(topology.llcs(),
+            (std::vector<std::vector<int>>{{0, 1, 4, 5}, {2, 3, 6, 7}}));
+
+  ASSERT_EQ(topology.nodes().size(), 2);
+  EXPECT_EQ(topology.nodes()[0].id, 0);
+  EXPECT_EQ(topology.nodes()[0].cpus, (std::vector<int>{0, 1, 4, 5}));
+  EXPECT_EQ(topology.nodes()[1].id, 1);
+  EXPECT_EQ(topology.nodes()[1].cpus, (std::vector<int>{2, 3, 6, 7}));
+
+  const auto* cpu6 = topology.cpu(6);
+  ASSERT_NE(cpu6, nullptr);
+  EXPECT_EQ(cpu6->core, 2);
+  EXPECT_EQ(cpu6->llc, 1);
+  EXPECT_EQ(cpu6->node, 1);
+  EXPECT_EQ(topology.node_of(5), 0);
+  EXPECT_EQ(topology.cpu(8), nullptr);
+}
+
+TEST(CpuTopology, one_per_core) {
+  FakeRoot root;
+  write_two_sockets(root);
+
+  auto topology = CpuTopology::detect(root.path());
+
+  EXPECT_EQ(topology.one_per_core({0, 1, 2, 3, 4, 5, 6, 7}),
+            (std::vector<int>{0, 1, 2, 3}));
+  EXPECT_EQ(topology.one_per_core({4, 5, 2}), (std::vector<int>{2, 4, 5}));
+}
+
+TEST(CpuTopology, offline_cpus_are_left_out) {
+  FakeRoot root;
+  write_two_sockets(root);
+  root.write("/sys/devices/system/cpu/online", "0-3\n");
+
+  auto topology = CpuTopology::detect(root.path());
+
+  EXPECT_EQ(topology.cpus().size(), 4);
+  EXPECT_EQ(topology.cores(),
+            (std::vector<std::vector<int>>{{0}, {1}, {2}, {3}}));
+  EXPECT_EQ(topology.nodes()[1].cpus, (std::vector<int>{2, 3}));
+}
+
+TEST(CpuTopology, flat_without_sysfs) {
+  FakeRoot root;
+  root.write("/sys/devices/system/cpu/online", "0-3\n");
+
+  auto topology = CpuTopology::detect(root.path());
+
+  EXPECT_EQ(topology.cores(),
+            (std::vector<std::vector<int>>{{0}, {1}, {2}, {3}}));
+  EXPECT_EQ(topology.llcs(), (std::vector<std::vector<int>>{{0, 1, 2, 3}}));
+  ASSERT_EQ(topology.nodes().size(), 1);
+  EXPECT_EQ(topology.nodes()[0].id, 0);
+  EXPECT_EQ(topology.nodes()[0].cpus, (std::vector<int>{0, 1, 2, 3}));
+}
+
+TEST(CpuTopology, this_machine) {
+  const auto& topology = CpuTopology::get();
+
+  EXPECT_FALSE(topology.cpus().empty());
+  EXPECT_FALSE(topology.nodes().empty());
+  EXPECT_NE(topology.cpu(sched_getcpu()), nullptr);
+}
+
+}  // namespace theta
@@ -0,0 +1,215 @@
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace theta {
+
+namespace {
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TraceRing>> rings;
+  size_t events_per_thread{Tracer::kDefaultEventsPerThread};
+};
+
+// Never destroyed, so that threads which exit after main can still drop
+// their rings.
+Registry& registry() {
+  static Registry* instance = new Registry;
+  return *instance;
+}
+
+// The registry holds the only other reference, so a ring whose use count
+// drops to one belongs to a thread that has exited.
+thread_local std::shared_ptr<TraceRing> local_ring;
+
+// Mirrors Task::State, which this library cannot depend on.
+const char* state_name(int8_t state) {
+  switch (state) {
+    case -1:
+      return "created";
+    case 1:
+      return "queued_executor";
+    case 2:
+      return "queued_threadpool";
+    case 3:
+      return "running";
+    case 4:
+      return "throttled";
+    case 5:
+      return "finished";
+    default:
+      return "unknown";
+  }
+}
+constexpr int8_t kCreated = -1;
+constexpr int8_t kFinished = 5;
+
+std::string pointer_id(const void* p) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\"%p\"", p);
+  return buf;
+}
+
+std::string usec(int64_t nsec) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", nsec / 1000.0);
+  return buf;
+}
+
+}  // namespace
+
+int64_t trace_now_nsec() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+TraceRing::TraceRing(size_t capacity, pid_t tid)
+    : mask_(std::bit_ceil(std::max<size_t>(1, capacity)) - 1),
+      tid_(tid),
+      events_(new TraceEvent[mask_ + 1]) {}
+
+std::vector<TraceEvent> TraceRing::copy() const {
+  uint64_t head = head_.load(std::memory_order::acquire);
+  uint64_t begin = head > mask_ ? head - mask_ - 1 : 0;
+
+  std::vector<TraceEvent> events;
+  events.reserve(head - begin);
+  for (uint64_t i = begin; i < head; i++) {
+    events.push_back(events_[i & mask_]);
+  }
+  return events;
+}
+
+/*static*/
+void Tracer::start(size_t events_per_thread) {
+  auto& r = registry();
+  std::lock_guard l{r.mutex};
+  r.events_per_thread = events_per_thread;
+  std::erase_if(r.rings, [](const std::shared_ptr<TraceRing>& ring) {
+    return ring.use_count() == 1;
+  });
+  for (auto& ring : r.rings) {
+    ring->clear();
+  }
+  enabled_.store(true, std::memory_order::release);
+}
+
+/*static*/
+void Tracer::stop() { enabled_.store(false, std::memory_order::release); }
+
+/*static*/
+void Tracer::record(const TraceEvent& event) {
+  if (!local_ring) {
+    auto& r = registry();
+    std::lock_guard l{r.mutex};
+    local_ring = std::make_shared<TraceRing>(
+        r.events_per_thread, static_cast<pid_t>(syscall(SYS_gettid)));
+    r.rings.push_back(local_ring);
+  }
+  local_ring->append(event);
+}
+
+/*static*/
+std::string Tracer::chrome_trace_json() {
+  struct Entry {
+    TraceEvent event;
+    pid_t tid;
+  };
+  std::vector<Entry> entries;
+  {
+    auto& r = registry();
+    std::lock_guard l{r.mutex};
+    for (const auto& ring : r.rings) {
+      for (const auto& event : ring->copy()) {
+        entries.push_back(Entry{event, ring->tid()});
+      }
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry& a, const Entry& b) {
+                     return a.event.ts_nsec < b.event.ts_nsec;
+                   });
+
+  std::string pid = std::to_string(getpid());
+  std::string s{"{\"displayTimeUnit\":\"ns\",\"traceEvents\":["};
+  bool first = true;
+  auto append = [&](const std::string& json) {
+    if (!first) {
+      s += ",\n";
+    }
+    first = false;
+    s += json;
+  };
+
+  std::unordered_map<pid_t, int64_t> sleeping_since;
+  std::unordered_set<pid_t> workers;
+  for (const auto& [event, tid] : entries) {
+    std::string common =
+        ",\"pid\":" + pid + ",\"tid\":" + std::to_string(tid) + "}";
+
+    switch (event.type) {
+      case TraceEvent::Type::kTaskState: {
+        std::string id = pointer_id(event.task);
+        if (event.from != kCreated) {
+          append(std::string{"{\"name\":\""} + state_name(event.from) +
+                 "\",\"cat\":\"task\",\"ph\":\"e\",\"id\":" + id +
+                 ",\"ts\":" + usec(event.ts_nsec) + common);
+        }
+        if (event.to != kFinished) {
+          append(std::string{"{\"name\":\""} + state_name(event.to) +
+                 "\",\"cat\":\"task\",\"ph\":\"b\",\"id\":" + id +
+                 ",\"ts\":" + usec(event.ts_nsec) +
+                 ",\"args\":{\"executor\":" + pointer_id(event.executor) +
+                 "}" + common);
+        }
+        break;
+      }
+      case TraceEvent::Type::kWorkerSleep:
+        workers.insert(tid);
+        sleeping_since[tid] = event.ts_nsec;
+        break;
+      case TraceEvent::Type::kWorkerWake: {
+        workers.insert(tid);
+        auto it = sleeping_since.find(tid);
+        if (it == sleeping_since.end()) {
+          break;
+        }
+        append("{\"name\":\"idle\",\"cat\":\"worker\",\"ph\":\"X\",\"ts\":" +
+               usec(it->second) + ",\"dur\":" +
+               usec(event.ts_nsec - it->second) + common);
+        sleeping_since.erase(it);
+        break;
+      }
+    }
+  }
+
+  for (pid_t tid : workers) {
+    append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+           ",\"tid\":" + std::to_string(tid) +
+           ",\"args\":{\"name\":\"worker " + std::to_string(tid) + "\"}}");
+  }
+
+  s += "]}\n";
+  return s;
+}
+
+/*static*/
+bool Tracer::write_chrome_trace(const std::string& path) {
+  std::ofstream out{path, std::ios::trunc};
+  out << chrome_trace_json();
+  return static_cast<bool>(out);
+}
+
+}  // namespace theta
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace theta {
+
+// A fixed-size record of one scheduling event.
+struct TraceEvent {
+  enum class Type : uint8_t {
+    kTaskState,
+    // A worker starts or stops waiting for a task.
+    kWorkerSleep,
+    kWorkerWake,
+  };
+
+  int64_t ts_nsec{0};
+  const void* task{nullptr};
+  const void* executor{nullptr};
+  Type type{Type::kTaskState};
+  // The Task::State values of a kTaskState transition.
+  int8_t from{0};
+  int8_t to{0};
+};
+static_assert(sizeof(TraceEvent) == 32, "");
+
+// A ring buffer of the most recent events recorded by one thread. Only that
+// thread appends, so appending is a plain store and a release of head_.
+class TraceRing {
+ public:
+  TraceRing(size_t capacity, pid_t tid);
+
+  void append(const TraceEvent& event) {
+    uint64_t head = head_.load(std::memory_order::relaxed);
+    events_[head & mask_] = event;
+    head_.store(head + 1, std::memory_order::release);
+  }
+
+  // The retained events, oldest first. Events that the owner overwrites
+  // while they are being copied may be torn, so call Tracer::stop() first
+  // for an exact copy.
+  std::vector<TraceEvent> copy() const;
+
+  void clear() { head_.store(0, std::memory_order::release); }
+
+  pid_t tid() const { return tid_; }
+
+ private:
+  const size_t mask_;
+  const pid_t tid_;
+  std::unique_ptr<TraceEvent[]> events_;
+  std::atomic<uint64_t> head_{0};
+};
+
+// Records task state transitions and worker sleeps into per-thread
+// TraceRings, and converts them into a Chrome trace that chrome://tracing
+// and the Perfetto UI can open. Tasks appear as async slices named after
+// their state, and the time that workers spend waiting for a task appears
+// as "idle" slices on the worker's thread.
+//
+// Tracing is off by default. While it is off, each trace_*() call costs one
+// relaxed load and a branch that is predicted not taken.
+class Tracer {
+ public:
+  static constexpr size_t kDefaultEventsPerThread = size_t{1} << 16;
+
+  static bool enabled() { return enabled_.load(std::memory_order::relaxed); }
+
+  // Discards everything recorded so far and starts recording. The capacity
+  // is rounded up to a power of two and only applies to threads that have
+  // not recorded before.
+  static void start(size_t events_per_thread = kDefaultEventsPerThread);
+  static void stop();
+
+  static void record(const TraceEvent& event);
+
+  static std::string chrome_trace_json();
+  // Returns false if the file could not be written.
+  static bool write_chrome_trace(const std::string& path);
+
+ private:
+  static inline std::atomic<bool> enabled_{false};
+};
+
+int64_t trace_now_nsec();
+
+inline void trace_task_state(const void* task, const void* executor, int from,
+                             int to) {
+  if (__builtin_expect(Tracer::enabled(), false)) {
+    Tracer::record(TraceEvent{.ts_nsec = trace_now_nsec(),
+                              .task = task,
+                              .executor = executor,
+                              .type = TraceEvent::Type::kTaskState,
+                              .from = static_cast<int8_t>(from),
+                              .to = static_cast<int8_t>(to)});
+  }
+}
+
+inline void trace_worker_sleep() {
+  if (__builtin_expect(Tracer::enabled(), false)) {
+    Tracer::record(TraceEvent{.ts_nsec = trace_now_nsec(),
+                              .type = TraceEvent::Type::kWorkerSleep});
+  }
+}
+
+inline void trace_worker_wake() {
+  if (__builtin_expect(Tracer::enabled(), false)) {
+    Tracer::record(TraceEvent{.ts_nsec = trace_now_nsec(),
+                              .type = TraceEvent::Type::kWorkerWake});
+  }
+}
+
+}  // namespace theta
@@ -0,0 +1,106 @@
+#include "trace.h"
+
+#include <glog/logging.h>
+
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+namespace {
+
+size_t count(const std::string& haystack, const std::string& needle) {
+  size_t n = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    n++;
+  }
+  return n;
+}
+
+// Task::State values.
+constexpr int kCreated = -1;
+constexpr int kQueuedExecutor = 1;
+constexpr int kRunning = 3;
+constexpr int kFinished = 5;
+
+}  // namespace
+
+TEST(TraceRing, keeps_the_newest_events) {
+  TraceRing ring{/*capacity=*/3, /*tid=*/1};
+  for (int i = 0; i < 10; i++) {
+    ring.append(TraceEvent{.ts_nsec = i});
+  }
+
+  // The capacity is rounded up to 4.
+  auto events = ring.copy();
+  ASSERT_EQ(events.size(), 4);
+  EXPECT_EQ(events.front().ts_nsec, 6);
+  EXPECT_EQ(events.back().ts_nsec, 9);
+}
+
+TEST(Tracer, nothing_is_recorded_while_disabled) {
+  Tracer::start();
+  Tracer::stop();
+  ASSERT_FALSE(Tracer::enabled());
+
+  int task;
+  trace_task_state(&task, nullptr, kCreated, kQueuedExecutor);
+  trace_worker_sleep();
+  trace_worker_wake();
+
+  EXPECT_EQ(count(Tracer::chrome_trace_json(), "\"ph\""), 0);
+}
+
+TEST(Tracer, chrome_trace) {
+  Tracer::start();
+
+  int task;
+  int executor;
+  trace_task_state(&task, &executor, kCreated, kQueuedExecutor);
+
+  std::thread worker([&]() {
+    trace_worker_sleep();
+    trace_worker_wake();
+    trace_task_state(&task, &executor, kQueuedExecutor, kRunning);
+    trace_task_state(&task, &executor, kRunning, kFinished);
+  });
+  worker.join();
+
+  Tracer::stop();
+  auto json = Tracer::chrome_trace_json();
+
+  EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0);
+  EXPECT_EQ(count(json, "\"name\":\"queued_executor\",\"cat\":\"task\","
+                        "\"ph\":\"b\""),
+            1);
+  EXPECT_EQ(count(json, "\"name\":\"queued_executor\",\"cat\":\"task\","
+                        "\"ph\":\"e\""),
+            1);
+  EXPECT_EQ(count(json, "\"name\":\"running\",\"cat\":\"task\",\"ph\":\"b\""),
+            1);
+  EXPECT_EQ(count(json, "\"name\":\"running\",\"cat\":\"task\",\"ph\":\"e\""),
+            1);
+  EXPECT_EQ(count(json, "\"name\":\"finished\""), 0);
+  EXPECT_EQ(count(json, "\"name\":\"idle\",\"cat\":\"worker\",\"ph\":\"X\""),
+            1);
+  EXPECT_EQ(count(json, "\"name\":\"thread_name\""), 1);
+
+  // The begin and end of each state share the task's id.
+  char id[32];
+  snprintf(id, sizeof(id), "\"id\":\"%p\"", static_cast<void*>(&task));
+  EXPECT_EQ(count(json, id), 4);
+}
+
+TEST(Tracer, start_discards_the_previous_recording) {
+  Tracer::start();
+  int task;
+  trace_task_state(&task, nullptr, kCreated, kQueuedExecutor);
+  Tracer::start();
+  Tracer::stop();
+
+  EXPECT_EQ(count(Tracer::chrome_trace_json(), "\"ph\""), 0);
+}
+
+}  // namespace theta
@@ -5,12 +5,37 @@
 #include <sched.h>
 #include <unistd.h>
 
+#include <span>
+#include <vector>
+
 #include "executor.h"
+#include "numa.h"
+#include "trace.h"
 
 namespace theta {
 
-Worker::Worker(TaskQueue<>* run_queue)
-    : run_queue_(run_queue), thread_(&Worker::run_loop, this) {}
+namespace {
+
+void set_affinity(pthread_t thread, const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  if (int err = pthread_setaffinity_np(thread, sizeof(set), &set); err != 0) {
+    LOG(WARNING) << "pthread_setaffinity_np failed: " << err;
+  }
+}
+
+}  // namespace
+
+Worker::Worker(RunQueue* run_queue, std::chrono::milliseconds idle_timeout,
+               RetireCallback retire_callback, Affinity affinity)
+    : run_queue_(run_queue),
+      idle_timeout_(idle_timeout),
+      retire_callback_(std::move(retire_callback)),
+      affinity_(std::move(affinity)),
+      thread_(&Worker::run_loop, this) {}
 
 Worker::~Worker() { thread_.join(); }
 
@@ -18,6 +43,19 @@ void Worker::shutdown() {
   run_queue_->shutdown();
 }
 
+void Worker::record_usage(ExecutorImpl* executor, const Usage& usage) {
+  std::lock_guard lock{usage_mutex_};
+  usage_[executor] += usage;
+}
+
+void Worker::drain_usage(std::unordered_map<ExecutorImpl*, Usage>* usage) {
+  std::lock_guard lock{usage_mutex_};
+  for (const auto& [executor, u] : usage_) {
+    (*usage)[executor] += u;
+  }
+  usage_.clear();
+}
+
 NicePriority Worker::nice_priority() const {
   return priority_.load(std::memory_order_acquire);
 }
@@ -29,6 +67,27 @@ void Worker::set_nice_priority(NicePriority priority) {
     return;
   }
 
+  // Storing and applying the priority under one lock keeps racing calls
+  // from leaving the affinity behind the last priority stored.
+  std::lock_guard lock{priority_mutex_};
+  if (priority_.exchange(priority, std::memory_order::acq_rel) == priority) {
+    return;
+  }
+  update_throttled_affinity(lock, priority == NicePriority::kThrottled);
+}
+
+void Worker::update_throttled_affinity(const std::lock_guard<std::mutex>&,
+                                       bool throttled) {
+  if (affinity_.throttled_cpus.empty()) {
+    return;
+  }
+
+  if (on_throttled_cpus_ == throttled) {
+    return;
+  }
+  on_throttled_cpus_ = throttled;
+  set_affinity(get_pthread(),
+               throttled ? affinity_.throttled_cpus : affinity_.cpus);
 }
 
 pthread_t Worker::get_pthread() {
@@ -36,22 +95,70 @@ pthread_t Worker::get_pthread() {
 }
 
 void Worker::run_loop() {
-  Task* task{nullptr};
+  if (!affinity_.cpus.empty()) {
+    set_affinity(pthread_self(), affinity_.cpus);
+  }
+  if (affinity_.node >= 0) {
+    prefer_node_for_thread(affinity_.node);
+  }
+
+  // Tasks that were claimed from the executor of the last task, which run
+  // here before the worker goes back to the run queue.
+  std::vector<Task*> batch;
+  size_t next = 0;
+  std::chrono::steady_clock::time_point slice_end;
   while (true) {
-    if (!task) {
-      task = run_queue_->wait_pop().release();
-    }
-    if (!task) {
-      CHECK(run_queue_->is_shutting_down());
-      return;
+    if (next == batch.size()) {
+      batch.clear();
+      next = 0;
+      trace_worker_sleep();
+      Task* task = run_queue_
+                       ->wait_pop_until(std::chrono::system_clock::now() +
+                                        idle_timeout_)
+                       .release();
+      trace_worker_wake();
+      if (!task) {
+        if (run_queue_->is_shutting_down() ||
+            retire_callback_(/*idle=*/true)) {
+          break;
+        }
+        continue;
+      }
+      batch.push_back(task);
     }
 
+    Task* task = batch[next++];
     auto* executor = task->opts().executor();
     task->set_worker(this);
     Task::run(std::unique_ptr<Task>(task));
-    task = nullptr;
-    executor->refill_queues(&task);
+
+    if (next < batch.size()) {
+      if (std::chrono::steady_clock::now() < slice_end) {
+        // The slot that the task held is not refilled until the batch is
+        // done, so let an idle worker admit whatever is waiting for it.
+        executor->maybe_mark_ready();
+        continue;
+      }
+      executor->release_batch(std::span{batch}.subspan(next));
+      batch.clear();
+      next = 0;
+      // The batch held the executor's active slots, so admit whatever
+      // waited on them.
+      executor->refill_queues();
+    } else {
+      batch.clear();
+      next = 0;
+      executor->refill_queues(&batch);
+      slice_end = std::chrono::steady_clock::now() +
+                  executor->opts()->batch_time_slice();
+    }
+
+    if (batch.empty() && retire_callback_(/*idle=*/false)) {
+      break;
+    }
   }
+
+  retired_.store(true, std::memory_order::release);
 }
 
 void Worker::maybe_update_priority() {
@@ -1,31 +1,95 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <mutex>
 #include <optional>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "run_queue.h"
 #include "task.h"
 
 namespace theta {
 
+class ExecutorImpl;
 class ThrottlingThreadpool;
 class Task;
 
+// Resource usage that a Worker accumulated on behalf of one Executor since the
+// scaler last collected it.
+struct Usage {
+  double wall_sec{0.0};
+  double utime_sec{0.0};
+  // Time that the tasks spent between post and starting on a worker.
+  double queue_wait_sec{0.0};
+  int64_t nivcsw{0};
+  uint64_t tasks{0};
+
+  Usage& operator+=(const Usage& other) {
+    wall_sec += other.wall_sec;
+    utime_sec += other.utime_sec;
+    queue_wait_sec += other.queue_wait_sec;
+    nivcsw += other.nivcsw;
+    tasks += other.tasks;
+    return *this;
+  }
+};
+
 class Worker {
  public:
-  Worker(TaskQueue<>* run_queue);
+  // Asked whether the worker should exit. idle is true when the worker went
+  // idle_timeout without finding a task and false after it ran a task.
+  using RetireCallback = std::function<bool(bool idle)>;
+
+  // Where a worker may run. Empty cpus leave the worker to the kernel.
+  struct Affinity {
+    std::vector<int> cpus;
+    // Where the worker runs while its task is throttled, so that throttled
+    // tasks stay off the SMT siblings of one another. Empty leaves them on
+    // cpus.
+    std::vector<int> throttled_cpus;
+    // The NUMA node that the worker's own allocations prefer, or -1 to leave
+    // them to the kernel.
+    int node{-1};
+  };
+
+  Worker(RunQueue* run_queue, std::chrono::milliseconds idle_timeout,
+         RetireCallback retire_callback, Affinity affinity = {});
   ~Worker();
 
   void shutdown();
 
+  // Whether the worker thread has returned, in which case the Worker only
+  // needs to be destroyed.
+  bool retired() const { return retired_.load(std::memory_order::acquire); }
+
+  // Called by the worker thread after each task. The mutex is only contended
+  // when the scaler is draining this worker.
+  void record_usage(ExecutorImpl* executor, const Usage& usage);
+  // Moves everything recorded so far into usage and resets the accumulators.
+  void drain_usage(std::unordered_map<ExecutorImpl*, Usage>* usage);
+
   NicePriority nice_priority() const;
   void set_nice_priority(NicePriority priority);
   pthread_t get_pthread();
 
  private:
-  TaskQueue<>* run_queue_;
+  RunQueue* run_queue_;
+  const std::chrono::milliseconds idle_timeout_;
+  const RetireCallback retire_callback_;
+  const Affinity affinity_;
+  std::atomic<bool> retired_{false};
   std::mutex priority_mutex_;
+  // Whether the worker is on affinity_.throttled_cpus. Guarded by
+  // priority_mutex_.
+  bool on_throttled_cpus_{false};
+
+  std::mutex usage_mutex_;
+  std::unordered_map<ExecutorImpl*, Usage> usage_;
 
   union Priority {
     Priority(NicePriority actual_, NicePriority postponed_) : actual(actual_), postponed(postponed_) {}
@@ -91,6 +155,8 @@ class Worker {
 
   void run_loop();
   void maybe_update_priority();
+  void update_throttled_affinity(const std::lock_guard<std::mutex>&,
+                                 bool throttled);
 };
 
 }  // namespace theta
@@ -0,0 +1,65 @@
+#include "worker.h"
+
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theta {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+std::vector<int> affinity_of(pthread_t thread) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CHECK_EQ(pthread_getaffinity_np(thread, sizeof(set), &set), 0);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace
+
+TEST(Worker, throttled_worker_moves_back_when_unthrottled) {
+  std::vector<int> allowed = affinity_of(pthread_self());
+  if (allowed.size() < 2) {
+    GTEST_SKIP() << "Needs two CPUs";
+  }
+
+  RunQueue run_queue;
+  Worker::Affinity affinity;
+  affinity.cpus = {allowed[0], allowed[1]};
+  affinity.throttled_cpus = {allowed[0]};
+  Worker worker{&run_queue, 1h, [](bool) { return false; }, affinity};
+
+  // The worker pins itself before it waits for a task.
+  while (run_queue.idle_workers() == 0) {
+    std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_EQ(affinity_of(worker.get_pthread()), affinity.cpus);
+
+  for (int i = 0; i < 2; i++) {
+    worker.set_nice_priority(NicePriority::kThrottled);
+    EXPECT_EQ(worker.nice_priority(), NicePriority::kThrottled);
+    EXPECT_EQ(affinity_of(worker.get_pthread()), affinity.throttled_cpus);
+
+    worker.set_nice_priority(NicePriority::kNormal);
+    EXPECT_EQ(worker.nice_priority(), NicePriority::kNormal);
+    EXPECT_EQ(affinity_of(worker.get_pthread()), affinity.cpus);
+  }
+
+  worker.shutdown();
+}
+
+}  // namespace theta